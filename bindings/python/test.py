@@ -23,6 +23,7 @@ import functools
 import json
 import os
 import tempfile
+import time
 import unittest
 
 import numpy as np
@@ -138,12 +139,52 @@ class TestEnsembleBasics(SimpleVoTETestCase):
             y_pred = self.ensemble.eval(x)
             self.assertAlmostEqual(y, y_pred[0])
 
+    def test_eval_batch(self):
+        rows = [[x] for x in [1, 2, 5, 6, 9, float('inf')]] * 50
+        for nb_threads in [1, 0]:
+            y_pred = self.ensemble.eval_batch(rows, nb_threads)
+            self.assertEqual(len(y_pred), len(rows))
+            for row, y in zip(rows, y_pred):
+                self.assertEqual(y, self.ensemble.eval(*row))
+
+    def test_eval_bitvector(self):
+        self.ensemble.set_backend('bitvector')
+        self.test_eval()
+
+    def test_approximate_bitvector(self):
+        inf = float('inf')
+        for domain in [(-inf, 2), (1, 6), (5, 5.5), (9, inf), (-inf, inf)]:
+            self.ensemble.set_backend('descent')
+            m1 = self.ensemble.approximate([domain])
+            self.ensemble.set_backend('bitvector')
+            m2 = self.ensemble.approximate([domain])
+            self.assertEqual(m1.outputs[0].lower, m2.outputs[0].lower)
+            self.assertEqual(m1.outputs[0].upper, m2.outputs[0].upper)
+            
     def test_serialize(self):
         o1 = json.loads(self.ensemble.serialize())
         o2 = json.loads(self.serialized_ensemble)
         self.assertEqual(o1, o2)
-        
-    
+
+    def test_serialize_single_output(self):
+        o = json.loads(self.serialized_ensemble)
+        for tree in o['trees']:
+            tree['nb_outputs'] = 2
+        o['trees'][0]['value'] = [[v[0], 0] for v in o['trees'][0]['value']]
+        o['trees'][1]['value'] = [[0, v[0]] for v in o['trees'][1]['value']]
+
+        e1 = vote.Ensemble.from_string(json.dumps(o))
+        s = json.loads(e1.serialize())
+        self.assertEqual([t['output'] for t in s['trees']], [0, 1])
+
+        e2 = vote.Ensemble.from_string(json.dumps(s))
+        for x in [1, 2, 5, 6, 9, float('inf')]:
+            y = e2.eval(x)
+            self.assertEqual(y, e1.eval(x))
+            self.assertAlmostEqual(y[0], self.t1(x) / 2.0)
+            self.assertAlmostEqual(y[1], self.t2(x) / 2.0)
+
+
 class TestMappingEdges(SimpleVoTETestCase):
     '''
     Check edges of mappings enumerated by VoTE against the oracle (f).
@@ -197,11 +238,134 @@ class TestForAll(SimpleVoTETestCase):
         self.assertTrue(res)
         self.assertEqual(self.count, 6)
 
+    def test_tree_order(self):
+        expected = set((m.inputs[0].lower, m.outputs[0].lower)
+                       for m in self.ensemble.mappings())
+        
+        for order in ['leaves', 'width']:
+            self.ensemble.set_tree_order(order)
+            outputs = set((m.inputs[0].lower, m.outputs[0].lower)
+                          for m in self.ensemble.mappings())
+            self.assertEqual(expected, outputs)
+
+            self.count = 0
+            self.assertTrue(self.ensemble.forall(self.increment_counter,
+                                                 nb_threads=4))
+            self.assertEqual(self.count, 6)
+
+    def test_search_order(self):
+        for order in ['worst', 'best']:
+            self.ensemble.set_search_order(order)
+            for nb_threads in [1, 4]:
+                self.count = 0
+                res = self.ensemble.forall(self.increment_counter,
+                                           nb_threads=nb_threads)
+                self.assertTrue(res)
+                self.assertEqual(self.count, 6)
+
+            self.count = 0
+            self.assertFalse(self.ensemble.forall(self.increment_counter_to_3))
+            self.assertEqual(self.count, 3)
+
+    def test_optimize(self):
+        best, witness = self.ensemble.maximize()
+        self.assertEqual(best, 3.5)
+        self.assertEqual(self.ensemble.eval(witness[0][1])[0], best)
+
+        best, witness = self.ensemble.minimize()
+        self.assertEqual(best, 0.5)
+        self.assertEqual(self.ensemble.eval(witness[0][1])[0], best)
+
+        self.assertEqual(self.ensemble.maximize(domain=[(6.5, 20)])[0], 2.5)
+        self.assertEqual(self.ensemble.minimize(domain=[(6.5, 20)])[0], 2)
+
+    def test_approximate_anytime(self):
+        m = self.ensemble.approximate()
+        self.assertEqual((m.outputs[0].lower, m.outputs[0].upper), (0, 4))
+
+        m = self.ensemble.approximate(max_nodes=1)
+        self.assertEqual((m.outputs[0].lower, m.outputs[0].upper), (0.5, 3.5))
+
+    def test_limits(self):
+        cb = lambda m: vote.PASS
+        self.assertEqual(self.ensemble.forall_limited(cb, max_mappings=6),
+                         vote.PASS)
+        for nb_threads in [1, 4]:
+            self.count = 0
+            res = self.ensemble.forall_limited(self.increment_counter,
+                                               nb_threads=nb_threads,
+                                               max_mappings=3)
+            self.assertEqual(res, vote.EXHAUSTED)
+            self.assertEqual(self.count, 3)
+
+        self.assertEqual(self.ensemble.forall_limited(cb, max_nodes=1),
+                         vote.EXHAUSTED)
+        cb = lambda m: vote.PASS if vote.mapping_precise(m) else vote.UNSURE
+        self.assertEqual(self.ensemble.absref_limited(cb, max_nodes=1),
+                         vote.EXHAUSTED)
+        self.assertEqual(self.ensemble.absref_limited(cb), vote.PASS)
+
+    def test_limits_fail(self):
+        # slow callbacks let idle workers steal the last mappings, and charge
+        # the budget past its limit while the fifth mapping is failing
+        def cb(m):
+            self.count += 1
+            if self.count < 5:
+                time.sleep(0.05)
+                return vote.PASS
+            time.sleep(0.2)
+            return vote.FAIL
+
+        for nb_threads in [1, 4]:
+            self.count = 0
+            res = self.ensemble.forall_limited(cb, nb_threads=nb_threads,
+                                               max_mappings=5)
+            self.assertEqual(res, vote.FAIL)
+
     def test_partial_forall(self):
         res = self.ensemble.forall(self.increment_counter_to_3)
         self.assertFalse(res)
         self.assertEqual(self.count, 3)
 
+    def test_lazy_postproc(self):
+        o = json.loads(self.serialized_ensemble)
+        o['post_process'] = 'sigmoid'
+        o['trees'][0]['value'] = [[v[0] - 3] for v in o['trees'][0]['value']]
+        e = vote.Ensemble.from_string(json.dumps(o))
+
+        eager = []
+        e.forall(lambda m: eager.append(m) or vote.PASS)
+        e.set_postproc_mode('lazy')
+        lazy = []
+        e.forall(lambda m: lazy.append(m) or vote.PASS)
+
+        self.assertEqual(len(eager), len(lazy))
+        self.assertEqual({vote.mapping_argmax(m) for m in lazy}, {0, 1})
+        for m1, m2 in zip(eager, lazy):
+            self.assertEqual(vote.mapping_argmax(m1), vote.mapping_argmax(m2))
+            vote.mapping_postproc(m2)
+            self.assertEqual(m1.outputs[0].lower, m2.outputs[0].lower)
+            self.assertEqual(m1.outputs[0].upper, m2.outputs[0].upper)
+
+    def test_mappings(self):
+        mappings = []
+        self.ensemble.forall(lambda m: mappings.append(m) or vote.PASS)
+        for m1, m2 in zip(self.ensemble.mappings(), mappings):
+            self.increment_counter(m1)
+            self.assertEqual(m1.inputs[0].lower, m2.inputs[0].lower)
+            self.assertEqual(m1.outputs[0].lower, m2.outputs[0].lower)
+        self.assertEqual(self.count, 6)
+
+    def test_parallel_forall(self):
+        res = self.ensemble.forall(self.increment_counter, nb_threads=4)
+        self.assertTrue(res)
+        self.assertEqual(self.count, 6)
+
+    def test_partial_parallel_forall(self):
+        res = self.ensemble.forall(self.increment_counter_to_3, nb_threads=4)
+        self.assertFalse(res)
+        self.assertGreaterEqual(self.count, 3)
+
 
 class TestAbsRef(SimpleVoTETestCase):
     outputs = None
@@ -235,6 +399,22 @@ class TestAbsRef(SimpleVoTETestCase):
         self.assertTrue(res)
         self.assertEqual(self.expected, self.outputs)
 
+    def test_parallel_absref(self):
+        res = self.ensemble.absref(self.add_outputs, nb_threads=4)
+        self.assertTrue(res)
+        self.assertEqual(self.expected, self.outputs)
+
+    def test_suffix_bounds(self):
+        self.ensemble.set_suffix_bounds(True)
+        res = self.ensemble.absref(self.add_outputs)
+        self.assertTrue(res)
+
+        # 5 < x <= 9: 2 + [0, 5], the second tree over the whole domain
+        self.assertIn((1, 3.5), self.outputs)
+
+        precise = set(o for o in self.expected if o[0] == o[1])
+        self.assertEqual(precise, set(o for o in self.outputs if o[0] == o[1]))
+
 
 class VoTEUtilityTestCase(SimpleVoTETestCase):
     
@@ -252,6 +432,21 @@ class VoTEUtilityTestCase(SimpleVoTETestCase):
     ],
     "post_process": "divisor"}'''
     
+    def test_difference_domain(self):
+        mappings = []
+        self.ensemble.set_abstract_domain('difference')
+        self.ensemble.absref(lambda m: mappings.append(m) or vote.UNSURE)
+
+        # every leaf is reachable from the first mapping, and all outputs
+        # share the lower bound, i.e. the first one is the reference
+        leaves = [[0, 1, 2], [1, 0, 2], [2, 1, 1], [3, 0, 0]]
+        m = mappings[0]
+        self.assertEqual(m.reference, 0)
+        for i in range(3):
+            d = [v[0] - v[i] for v in leaves]
+            self.assertEqual(m.differences[i].lower, min(d))
+            self.assertEqual(m.differences[i].upper, max(d))
+
     def test_argmax(self):
         self.assertEqual(0, vote.argmax([5,4,3,2,1]))
         self.assertEqual(1, vote.argmax([0,4,3,2,1]))
@@ -31,6 +31,7 @@ from _vote import lib as _lib
 
 __version__ = _ffi.string(_lib.vote_version())
 
+EXHAUSTED = -2
 UNSURE = -1
 FAIL = 0
 PASS = 1
@@ -63,6 +64,14 @@ def mapping_precise(mapping):
     return _lib.vote_mapping_precise(mapping)
 
 
+def mapping_postproc(mapping):
+    '''
+    Apply the post processing that is pending on the outputs of a *mapping*,
+    e.g. to obtain probabilities from logits.
+    '''
+    _lib.vote_mapping_postproc(mapping)
+
+
 def mapping_argmax(mapping):
     '''
     Returns the index of the largest output value in a *mapping*.
@@ -118,6 +127,17 @@ def _vote_mapping_python_cb(ctx, mapping):
     return callback(mapping)
 
 
+def _mk_limits(max_seconds, max_nodes, max_mappings):
+    '''
+    Create limits on the work of an analysis, where zero is unlimited.
+    '''
+    limits = _ffi.new('vote_limits_t*')
+    limits.max_seconds = max_seconds
+    limits.max_nodes = max_nodes
+    limits.max_mappings = max_mappings
+    return limits
+
+
 def _mk_bounds(dims, limits):
     '''
     Create an array of bounds with length *dims*, and initialize the bounds with
@@ -380,6 +400,60 @@ class Ensemble:
         tbl = ('none', 'divisor', 'softmax', 'sigmoid')
         return tbl[self.ptr.post_process]
     
+    def set_backend(self, name):
+        '''
+        Select the algorithm used to find the leaves reachable from an input
+        region, i.e. 'descent' (the default) or 'bitvector'.
+        '''
+        tbl = ('descent', 'bitvector')
+        _lib.vote_ensemble_set_backend(self.ptr, tbl.index(name))
+
+    def set_postproc_mode(self, name):
+        '''
+        Select when the outputs of mappings passed to callbacks are post
+        processed, i.e. 'eager' (the default) or 'lazy', in which case
+        softmax and sigmoid outputs are left as logits.
+        '''
+        tbl = ('eager', 'lazy')
+        _lib.vote_ensemble_set_postproc_mode(self.ptr, tbl.index(name))
+
+    def set_abstract_domain(self, name):
+        '''
+        Select the abstract domain used to bound outputs, i.e. 'interval' (the
+        default) or 'difference', in which case abstract mappings also bound
+        the difference between the output with the largest lower bound and
+        every output.
+        '''
+        tbl = ('interval', 'difference')
+        _lib.vote_ensemble_set_domain(self.ptr, tbl.index(name))
+
+    def set_suffix_bounds(self, enabled):
+        '''
+        Enable or disable suffix bounds, i.e. let absref first try to decide
+        abstract mappings with the bounds of the remaining trees over the
+        whole input domain of the analysis.
+        '''
+        _lib.vote_ensemble_set_suffix_bounds(self.ptr, enabled)
+
+    def set_tree_order(self, name):
+        '''
+        Select the order in which trees are refined, i.e. 'file' (the
+        default), 'leaves' where trees with few reachable leaves go first, or
+        'width' where trees with wide output bounds go first.
+        '''
+        tbl = ('file', 'leaves', 'width')
+        _lib.vote_ensemble_set_order(self.ptr, tbl.index(name))
+
+    def set_search_order(self, name):
+        '''
+        Select the order in which the children of split nodes are visited,
+        i.e. 'small' (the default) for the child with the least input space
+        first, 'worst' for the child most likely to change the argmax first,
+        or 'best' for a best-first search by that likelihood.
+        '''
+        tbl = ('small', 'worst', 'best')
+        _lib.vote_ensemble_set_search(self.ptr, tbl.index(name))
+        
     def eval(self, *args):
         '''
         Evaluate this ensemble on a concrete sample.
@@ -390,11 +464,32 @@ class Ensemble:
         _lib.vote_ensemble_eval(self.ptr, inputs, outputs)
         return list(outputs)
 
-    def forall(self, callback, domain=None):
+    def eval_batch(self, rows, nb_threads=1):
+        '''
+        Evaluate this ensemble on a sequence of concrete samples. With more
+        than one thread (zero means one per online processor), the samples
+        are distributed among the threads.
+        '''
+        rows = list(rows)
+        values = [x for row in rows for x in row]
+        inputs = _ffi.new('real_t[%d]' % len(values), values)
+        outputs = _ffi.new('real_t[%d]' % (len(rows) * self.nb_outputs))
+
+        if nb_threads == 1:
+            _lib.vote_ensemble_eval_batch(self.ptr, inputs, len(rows), outputs)
+        else:
+            _lib.vote_ensemble_eval_batch_parallel(self.ptr, inputs, len(rows),
+                                                   outputs, nb_threads)
+
+        n = self.nb_outputs
+        return [list(outputs[i*n:(i+1)*n]) for i in range(len(rows))]
+
+    def forall(self, callback, domain=None, nb_threads=1):
         '''
         Enumerate all precise mappings of this ensemble for some input *domain*
         until the *callback* function returns FAIL, or all mappings
-        have been enumerated.
+        have been enumerated. With more than one thread, the *callback*
+        function is invoked concurrently, in no particular order.
 
         Returns true if all mappings PASS the callback function, or
         false if any of the mappings FAIL the callback function.
@@ -402,12 +497,49 @@ class Ensemble:
         bounds = _mk_bounds(self.nb_inputs, domain)
         ctx = _ffi.new_handle(callback)
         cb = _lib._vote_mapping_python_cb
-        return _lib.vote_ensemble_forall(self.ptr, bounds, cb, ctx)
+        if nb_threads == 1:
+            return _lib.vote_ensemble_forall(self.ptr, bounds, cb, ctx)
+        else:
+            return _lib.vote_ensemble_forall_parallel(self.ptr, bounds, cb,
+                                                      ctx, nb_threads)
+
+    def forall_limited(self, callback, domain=None, nb_threads=1,
+                       max_seconds=0, max_nodes=0, max_mappings=0):
+        '''
+        Enumerate precise mappings like forall(), but stop once *max_seconds*
+        have passed, *max_nodes* tree nodes have been visited, or
+        *max_mappings* mappings have been enumerated. Zero is unlimited.
 
-    def absref(self, callback, domain=None):
+        Returns PASS, FAIL, or EXHAUSTED if the enumeration was stopped by
+        one of its limits.
+        '''
+        bounds = _mk_bounds(self.nb_inputs, domain)
+        limits = _mk_limits(max_seconds, max_nodes, max_mappings)
+        ctx = _ffi.new_handle(callback)
+        cb = _lib._vote_mapping_python_cb
+        return _lib.vote_ensemble_forall_limited(self.ptr, bounds, cb, ctx,
+                                                 nb_threads, limits)
+
+    def mappings(self, domain=None):
+        '''
+        Iterate all precise mappings of this ensemble for some input *domain*,
+        one at the time, in the same order as forall() enumerates them.
+        '''
+        bounds = _mk_bounds(self.nb_inputs, domain)
+        it = _ffi.gc(_lib.vote_iter_new(self.ptr, bounds), _lib.vote_iter_del)
+
+        while True:
+            mapping = _lib.vote_iter_next(it)
+            if mapping == _ffi.NULL:
+                break
+            yield mapping_copy(mapping)
+
+    def absref(self, callback, domain=None, nb_threads=1):
         '''
         Enumerate abstract mappings of this ensemble using an 
-        abstraction-refinement approach for some input *domain*.
+        abstraction-refinement approach for some input *domain*. With more
+        than one thread, the *callback* function is invoked concurrently,
+        in no particular order.
 
         Returns true if all conclusive mappings PASS the callback function, or
         false if any of the conclusive mappings FAIL the callback function.
@@ -415,16 +547,62 @@ class Ensemble:
         bounds = _mk_bounds(self.nb_inputs, domain)
         ctx = _ffi.new_handle(callback)
         cb = _lib._vote_mapping_python_cb
-        return _lib.vote_ensemble_absref(self.ptr, bounds, cb, ctx)
+        if nb_threads == 1:
+            return _lib.vote_ensemble_absref(self.ptr, bounds, cb, ctx)
+        else:
+            return _lib.vote_ensemble_absref_parallel(self.ptr, bounds, cb, ctx,
+                                                      nb_threads, _ffi.NULL)
+
+    def absref_limited(self, callback, domain=None, nb_threads=1,
+                       max_seconds=0, max_nodes=0, max_mappings=0):
+        '''
+        Enumerate abstract mappings like absref(), but stop once the limits
+        are reached, see forall_limited().
+        '''
+        bounds = _mk_bounds(self.nb_inputs, domain)
+        limits = _mk_limits(max_seconds, max_nodes, max_mappings)
+        ctx = _ffi.new_handle(callback)
+        cb = _lib._vote_mapping_python_cb
+        return _lib.vote_ensemble_absref_limited(self.ptr, bounds, cb, ctx,
+                                                 nb_threads, limits)
 
-    def approximate(self, domain=None):
+    def approximate(self, domain=None, max_nodes=None, max_seconds=None):
         '''
         Approximate a pessimistic and sound mapping for a given input *domain*.
+        With a budget of *max_nodes* refined regions or *max_seconds*, regions
+        with the widest output bounds are refined until the budget runs out.
         '''
         bounds = _mk_bounds(self.nb_inputs, domain)
-        ptr = _lib.vote_ensemble_approximate(self.ptr, bounds)
+        if max_nodes is None and max_seconds is None:
+            ptr = _lib.vote_ensemble_approximate(self.ptr, bounds)
+        else:
+            ptr = _lib.vote_ensemble_approximate_anytime(self.ptr, bounds,
+                                                         max_nodes or 0,
+                                                         max_seconds or 0)
         return _ffi.gc(ptr, _lib.vote_mapping_del)
 
+    def maximize(self, output=0, domain=None):
+        '''
+        Compute the largest value of an *output* for a given input *domain*,
+        together with an input region where that value is attained.
+        '''
+        bounds = _mk_bounds(self.nb_inputs, domain)
+        witness = _mk_bounds(self.nb_inputs, None)
+        best = _ffi.new('real_t*')
+        _lib.vote_ensemble_maximize(self.ptr, bounds, output, best, witness)
+        return best[0], [(b.lower, b.upper) for b in witness]
+
+    def minimize(self, output=0, domain=None):
+        '''
+        Compute the smallest value of an *output* for a given input *domain*,
+        together with an input region where that value is attained.
+        '''
+        bounds = _mk_bounds(self.nb_inputs, domain)
+        witness = _mk_bounds(self.nb_inputs, None)
+        best = _ffi.new('real_t*')
+        _lib.vote_ensemble_minimize(self.ptr, bounds, output, best, witness)
+        return best[0], [(b.lower, b.upper) for b in witness]
+
     def serialize(self):
         '''
         Serialize the ensemble into a JSON-formatted string.
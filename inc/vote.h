@@ -50,13 +50,35 @@ typedef struct vote_bound {
 
 
 /**
- * A mapping from an input region to an output range.
+ * Post process an ensemble with an algorithm that differentiates e.g.
+ * the random forest models from gradient boosting models during prediction.
+ **/
+typedef enum vote_post_process {
+  VOTE_POST_PROCESS_NONE     = 0,
+  VOTE_POST_PROCESS_DIVISOR  = 1,
+  VOTE_POST_PROCESS_SOFTMAX  = 2,
+  VOTE_POST_PROCESS_SIGMOID  = 3
+} vote_post_process_t;
+
+
+/**
+ * A mapping from an input region to an output range. The outputs of softmax
+ * and sigmoid ensembles may be raw sums of leaves (logits) that have yet to be
+ * post processed, in which case post_process is the pending algorithm, see
+ * vote_mapping_postproc(). Otherwise, it is VOTE_POST_PROCESS_NONE.
+ *
+ * Abstract mappings may also bound the differences between a reference output
+ * and every output before post processing, i.e. differences[i] bounds the
+ * difference outputs[reference] - outputs[i]. Otherwise, differences is NULL.
  **/
 typedef struct vote_mapping {
-  vote_bound_t* inputs;
-  vote_bound_t* outputs;
-  size_t        nb_inputs;
-  size_t        nb_outputs;
+  vote_bound_t*       inputs;
+  vote_bound_t*       outputs;
+  size_t              nb_inputs;
+  size_t              nb_outputs;
+  vote_post_process_t post_process;
+  vote_bound_t*       differences;
+  size_t              reference;
 } vote_mapping_t;
 
 
@@ -68,41 +90,179 @@ typedef struct vote_tree vote_tree_t;
 
 
 /**
- * Post process an ensemble with an algorithm that differentiates e.g.
- * the random forest models from gradient boosting models during prediction.
+ * Algorithms for finding the leaves of a tree that are reachable from an
+ * input region, i.e. a recursive descent into the tree, or bitwise
+ * elimination of leaves below splits the region cannot satisfy.
  **/
-typedef enum vote_post_process {
-  VOTE_POST_PROCESS_NONE     = 0,
-  VOTE_POST_PROCESS_DIVISOR  = 1,
-  VOTE_POST_PROCESS_SOFTMAX  = 2,
-  VOTE_POST_PROCESS_SIGMOID  = 3
-} vote_post_process_t;
+typedef enum vote_backend {
+  VOTE_BACKEND_DESCENT   = 0,
+  VOTE_BACKEND_BITVECTOR = 1
+} vote_backend_t;
+
+
+/**
+ * When to post process the outputs of mappings that are passed to callbacks,
+ * i.e. always, or only when a callback asks for it. Softmax and sigmoid
+ * preserve the order of outputs, so decisions on the argmax or argmin can be
+ * made on logits without computing any probabilities.
+ **/
+typedef enum vote_postproc_mode {
+  VOTE_POSTPROC_EAGER = 0,
+  VOTE_POSTPROC_LAZY  = 1
+} vote_postproc_mode_t;
+
+
+/**
+ * Abstract domains used to bound the outputs of an ensemble, i.e. an interval
+ * on each output, or in addition intervals on the differences between the
+ * output with the largest lower bound and every other output. The latter is
+ * costlier, but captures outputs that are correlated within trees, e.g. class
+ * probabilities in random forests.
+ **/
+typedef enum vote_domain {
+  VOTE_DOMAIN_INTERVAL   = 0,
+  VOTE_DOMAIN_DIFFERENCE = 1
+} vote_domain_t;
+
+
+/**
+ * Heuristics that decide the order in which trees are refined, i.e. the order
+ * in which they appear in the ensemble, by ascending number of leaves that
+ * are reachable from the input region, or by descending width of the join of
+ * the outputs of each tree over the input region.
+ **/
+typedef enum vote_order {
+  VOTE_ORDER_FILE   = 0,
+  VOTE_ORDER_LEAVES = 1,
+  VOTE_ORDER_WIDTH  = 2
+} vote_order_t;
+
+
+/**
+ * Orders in which refinements visit the children of the nodes they split,
+ * i.e. depth-first starting with the child with the least input space,
+ * depth-first starting with the child that is the most likely to change the
+ * argmax, or best-first by that likelihood among all open regions of a tree.
+ * Best-first keeps a bounded number of regions open, and resorts to
+ * depth-first when there is no room for more.
+ **/
+typedef enum vote_search {
+  VOTE_SEARCH_SMALL_FIRST = 0,
+  VOTE_SEARCH_WORST_FIRST = 1,
+  VOTE_SEARCH_BEST_FIRST  = 2
+} vote_search_t;
+
+
+/**
+ * Strategies for iterating the mappings of an ensemble, i.e. refining all
+ * trees one at the time, or interleaving abstraction and refinement.
+ *
+ * The classwise strategy interleaves abstraction and refinement on each class
+ * independently, and leaves trees of classes that can no longer be the argmax
+ * unrefined. Mappings passed to the callback are then only precise in the
+ * classes that may still be the argmax, which suffices for callbacks that
+ * decide on the argmax, e.g. vote_mapping_check_argmax(). Ensembles that post
+ * process outputs eagerly with softmax or sigmoid are refined as with absref.
+ **/
+typedef enum vote_strategy {
+  VOTE_STRATEGY_REFINE    = 0,
+  VOTE_STRATEGY_ABSREF    = 1,
+  VOTE_STRATEGY_CLASSWISE = 2
+} vote_strategy_t;
+
+
+/**
+ * A reusable plan for iterating the mappings of an ensemble with a particular
+ * strategy. A plan owns its pipeline stages, scratch buffers and, if needed,
+ * a pool of worker threads, all of which are allocated once when the plan is
+ * created.
+ **/
+typedef struct vote_plan vote_plan_t;
+
+
+/**
+ * A pull-style iterator over the precise mappings of an ensemble. Trees are
+ * refined one after the other using an explicit stack rather than recursion,
+ * so an iteration may be suspended between any two mappings.
+ **/
+typedef struct vote_iter vote_iter_t;
 
 
 /**
  * An ensemble is a collection of trees.
  **/
 typedef struct vote_ensemble {
-  vote_tree_t       **trees;
-  size_t              nb_trees;
-  size_t              nb_inputs;
-  size_t              nb_outputs;
-  size_t              nb_nodes;
-  vote_post_process_t post_process;
+  vote_tree_t        **trees;
+  size_t               nb_trees;
+  size_t               nb_inputs;
+  size_t               nb_outputs;
+  size_t               nb_nodes;
+  vote_post_process_t  post_process;
+  vote_postproc_mode_t postproc_mode;
+  vote_domain_t        domain;
+  bool                 suffix_bounds;
+  vote_order_t         order;
+  vote_search_t        search;
 } vote_ensemble_t;
 
 
 /**
  * The outcome of a property checker can be inconclusive when approximations
- * are too conservative.
+ * are too conservative. Analyses that run out of their limits are neither
+ * passed nor failed, but exhausted.
  **/
 typedef enum vote_outcome {
-  VOTE_UNSURE = -1,
-  VOTE_FAIL   = 0,
-  VOTE_PASS   = 1
+  VOTE_EXHAUSTED = -2,
+  VOTE_UNSURE    = -1,
+  VOTE_FAIL      = 0,
+  VOTE_PASS      = 1
 } vote_outcome_t;
 
 
+/**
+ * Limits on the work of a single run of an analysis, i.e. the number of
+ * seconds of wall-clock time since the start of the run, the number of tree
+ * nodes visited during refinement, and the number of mappings passed to the
+ * callback. Zero means unlimited. Another thread may stop the run by setting
+ * the optional cancel flag.
+ **/
+typedef struct vote_limits {
+  double  max_seconds;
+  size_t  max_nodes;
+  size_t  max_mappings;
+  bool   *cancel;
+} vote_limits_t;
+
+
+/**
+ * Counters of the work an analysis carried out for a single tree, i.e. the
+ * mappings that reached the abstraction preceding the refinement of the tree,
+ * how many of those the abstraction settled, bypassed around the tree, or
+ * passed on to its refinement, and the nodes and leaves the refinement visited.
+ **/
+typedef struct vote_tree_stats {
+  size_t nb_abstracted;
+  size_t nb_settled;
+  size_t nb_bypassed;
+  size_t nb_refined;
+  size_t nb_nodes;
+  size_t nb_leaves;
+} vote_tree_stats_t;
+
+
+/**
+ * Counters of the work an analysis carried out, for each tree in the order of
+ * the ensemble and aggregated over all trees, together with the number of
+ * mappings that reached the callback.
+ **/
+typedef struct vote_stats {
+  size_t             nb_trees;
+  vote_tree_stats_t *trees;
+  vote_tree_stats_t  total;
+  size_t             nb_mappings;
+} vote_stats_t;
+
+
 /**
  * A dataset in the form of a matrix of reals.
  **/
@@ -121,6 +281,14 @@ typedef struct vote_dataset {
 typedef vote_outcome_t (vote_mapping_cb_t)(void *ctx, vote_mapping_t *mapping);
 
 
+/**
+ * Callback function prototype used to report the progress of an optimization,
+ * i.e. the best output value attained so far, and a bound on the optimum.
+ * Returning false stops the optimization.
+ **/
+typedef bool (vote_progress_cb_t)(void *ctx, real_t best, real_t bound);
+
+
 /**
  * Obtain the version number of VoTE.
  **/
@@ -162,7 +330,7 @@ void vote_dataset_del(vote_dataset_t* ds);
 /**
  * Get the row at a particular index in a dataset.
  **/
-real_t* vote_dataset_row(vote_dataset_t* ds, size_t index);
+real_t* vote_dataset_row(const vote_dataset_t* ds, size_t index);
 
 
 /**
@@ -195,6 +363,13 @@ vote_outcome_t vote_mapping_check_argmin(const vote_mapping_t* m, size_t expecte
 bool vote_mapping_precise(const vote_mapping_t* m);
 
 
+/**
+ * Apply the post processing that is pending on the outputs of a mapping, if
+ * any, e.g. to obtain probabilities from logits.
+ **/
+void vote_mapping_postproc(vote_mapping_t* m);
+
+
 /**
  * Compute the argmax of a mapping.
  *
@@ -259,6 +434,59 @@ bool vote_ensemble_save_file(const vote_ensemble_t *e, const char *filename);
 void vote_ensemble_del(vote_ensemble_t* f);
 
 
+/**
+ * Select the algorithm used to find reachable leaves when approximating and
+ * evaluating an ensemble. The descent is used by default. Must not be called
+ * while the ensemble is being analyzed.
+ **/
+void vote_ensemble_set_backend(vote_ensemble_t* f, vote_backend_t backend);
+
+
+/**
+ * Select when to post process the outputs of mappings that are passed to
+ * callbacks. Mappings are post processed eagerly by default. Must not be
+ * called while the ensemble is being analyzed.
+ **/
+void vote_ensemble_set_postproc_mode(vote_ensemble_t* f,
+				     vote_postproc_mode_t mode);
+
+
+/**
+ * Select the abstract domain used to bound outputs when abstracting an
+ * ensemble. Intervals are used by default. Must not be called while the
+ * ensemble is being analyzed.
+ **/
+void vote_ensemble_set_domain(vote_ensemble_t* f, vote_domain_t domain);
+
+
+/**
+ * Enable or disable suffix bounds when abstracting an ensemble, i.e. bounds
+ * on the sum of the outputs of the trees i..n over the whole input region
+ * of an analysis. Each abstraction then first tries to decide a mapping with
+ * those bounds, and only joins the trees when that is inconclusive. Disabled
+ * by default. Must not be called while the ensemble is being analyzed.
+ **/
+void vote_ensemble_set_suffix_bounds(vote_ensemble_t* f, bool enabled);
+
+
+/**
+ * Select the heuristic that orders the refinement of trees. Enumerations on
+ * the calling thread pick the next tree for each input region they refine,
+ * while pipelines order the trees once for each analysis. Trees are refined
+ * in file order by default. Must not be called while the ensemble is being
+ * analyzed.
+ **/
+void vote_ensemble_set_order(vote_ensemble_t* f, vote_order_t order);
+
+
+/**
+ * Select the order in which refinements visit the children of the nodes they
+ * split. The child with the least input space is visited first by default.
+ * Must not be called while the ensemble is being analyzed.
+ **/
+void vote_ensemble_set_search(vote_ensemble_t* f, vote_search_t search);
+
+
 /**
  * Evaluate an ensemble on concrete values.
  **/
@@ -266,6 +494,24 @@ void vote_ensemble_eval(const vote_ensemble_t* f, const real_t *inputs,
 			real_t *outputs);
 
 
+/**
+ * Evaluate an ensemble on a number of rows of concrete values, stored one
+ * after another with nb_inputs values each. Outputs are stored likewise with
+ * nb_outputs values per row.
+ **/
+void vote_ensemble_eval_batch(const vote_ensemble_t* f, const real_t *rows,
+			      size_t nb_rows, real_t *outputs);
+
+
+/**
+ * Evaluate an ensemble on a number of rows of concrete values using a number
+ * of threads (zero means one thread per online processor).
+ **/
+void vote_ensemble_eval_batch_parallel(const vote_ensemble_t* f,
+				       const real_t *rows, size_t nb_rows,
+				       real_t *outputs, size_t nb_threads);
+
+
 /**
  * Iterate all feasible mappings of an ensemble for some input region.
  *
@@ -275,6 +521,23 @@ bool vote_ensemble_forall(const vote_ensemble_t *f, const vote_bound_t* input_re
 			  vote_mapping_cb_t *cb, void* ctx);
 
 
+/**
+ * Iterate all feasible mappings of an ensemble for some input region using
+ * a number of threads (zero means one thread per online processor). Regions
+ * of the input space are split off and stolen by idle threads.
+ *
+ * The callback is invoked concurrently from several threads, in no particular
+ * order, and must hence be thread-safe. Once a callback returns an outcome
+ * other than pass, all threads stop as soon as possible.
+ *
+ * Returns true if all mappings were satisified, and false if any were unsatisfied.
+ **/
+bool vote_ensemble_forall_parallel(const vote_ensemble_t *f,
+				   const vote_bound_t* input_region,
+				   vote_mapping_cb_t *cb, void* ctx,
+				   size_t nb_threads);
+
+
 /**
  * Iterate abstract mappings of an ensemble using a abstraction-refinement approach
  * for some input region.
@@ -285,6 +548,165 @@ bool vote_ensemble_absref(const vote_ensemble_t *f, const vote_bound_t* input_re
 			  vote_mapping_cb_t *cb, void* ctx);
 
 
+/**
+ * Iterate abstract mappings of an ensemble using a abstraction-refinement approach
+ * for some input region using a number of threads (zero means one thread per
+ * online processor). Regions that cannot be decided by abstraction are split
+ * off and stolen by idle threads.
+ *
+ * The callback must be thread-safe, see vote_ensemble_forall_parallel(). If
+ * nb_tasks is given, it must have room for nb_threads elements, and is filled
+ * with the number of tasks carried out by each thread. It is left untouched
+ * when nb_threads is zero, see vote_plan_tasks() for a plan with as many
+ * threads as there are online processors.
+ *
+ * Returns true if all mappings were satisified, and false if any were unsatisfied.
+ **/
+bool vote_ensemble_absref_parallel(const vote_ensemble_t *f,
+				   const vote_bound_t* input_region,
+				   vote_mapping_cb_t *cb, void* ctx,
+				   size_t nb_threads, size_t *nb_tasks);
+
+
+/**
+ * Iterate precise mappings of an ensemble like vote_ensemble_forall_parallel()
+ * within some limits. The limits may be NULL.
+ *
+ * Returns VOTE_PASS if all mappings were satisfied, VOTE_FAIL if any were
+ * unsatisfied, and VOTE_EXHAUSTED if the iteration was stopped by its limits.
+ **/
+vote_outcome_t vote_ensemble_forall_limited(const vote_ensemble_t *f,
+					    const vote_bound_t* input_region,
+					    vote_mapping_cb_t *cb, void* ctx,
+					    size_t nb_threads,
+					    const vote_limits_t *limits);
+
+
+/**
+ * Iterate abstract mappings of an ensemble like
+ * vote_ensemble_absref_parallel() within some limits, see
+ * vote_ensemble_forall_limited().
+ **/
+vote_outcome_t vote_ensemble_absref_limited(const vote_ensemble_t *f,
+					    const vote_bound_t* input_region,
+					    vote_mapping_cb_t *cb, void* ctx,
+					    size_t nb_threads,
+					    const vote_limits_t *limits);
+
+
+/**
+ * Create an iterator over all feasible mappings of an ensemble for some input
+ * region. Mappings are produced in the same order as vote_ensemble_forall().
+ **/
+vote_iter_t* vote_iter_new(const vote_ensemble_t *f,
+			   const vote_bound_t* input_region);
+
+
+/**
+ * Restart an iterator on some other input region.
+ **/
+void vote_iter_reset(vote_iter_t *it, const vote_bound_t* input_region);
+
+
+/**
+ * Get the next mapping of an iterator, or NULL when all mappings have been
+ * produced. The mapping is owned by the iterator, and remains valid until
+ * the next call.
+ **/
+vote_mapping_t* vote_iter_next(vote_iter_t *it);
+
+
+/**
+ * Delete an iterator and free associated resources.
+ **/
+void vote_iter_del(vote_iter_t *it);
+
+
+/**
+ * Create a plan for iterating the mappings of an ensemble with a strategy
+ * using a number of threads (zero means one thread per online processor). A
+ * plan with one thread runs on the calling thread, while the threads of other
+ * plans are created once, and kept waiting between runs until the plan is
+ * deleted. A plan whose threads cannot be created runs on the calling thread
+ * as well, see vote_plan_size().
+ *
+ * A plan can be run repeatedly, but not concurrently. Threads that analyze
+ * an ensemble concurrently should create one plan each.
+ **/
+vote_plan_t* vote_plan_new(const vote_ensemble_t *f, vote_strategy_t strategy,
+			   size_t nb_threads);
+
+
+/**
+ * Delete a plan and free associated resources.
+ **/
+void vote_plan_del(vote_plan_t *p);
+
+
+/**
+ * Iterate the mappings of an ensemble for some input region, see
+ * vote_ensemble_forall() and vote_ensemble_absref(). With several threads,
+ * the callback must be thread-safe, see vote_ensemble_forall_parallel().
+ *
+ * Returns true if all mappings were satisified, and false if any were unsatisfied.
+ **/
+bool vote_plan_run(vote_plan_t *p, const vote_bound_t* input_region,
+		   vote_mapping_cb_t *cb, void* ctx);
+
+
+/**
+ * Iterate the mappings of an ensemble for some input region within some
+ * limits, see vote_plan_run(). The limits may be NULL.
+ *
+ * Returns VOTE_PASS if all mappings were satisfied, VOTE_FAIL if any were
+ * unsatisfied, and VOTE_EXHAUSTED if the run was stopped by its limits.
+ **/
+vote_outcome_t vote_plan_run_limited(vote_plan_t *p,
+				     const vote_bound_t* input_region,
+				     vote_mapping_cb_t *cb, void* ctx,
+				     const vote_limits_t *limits);
+
+
+/**
+ * Enable or disable the collection of statistics during the runs of a plan.
+ * Plans that collect statistics refine trees with pipeline components, and
+ * never with an iterator.
+ **/
+void vote_plan_set_stats(vote_plan_t *p, bool enabled);
+
+
+/**
+ * Add the statistics collected during all runs of a plan to some statistics,
+ * see vote_plan_set_stats().
+ **/
+void vote_plan_stats(const vote_plan_t *p, vote_stats_t *stats);
+
+
+/**
+ * Create zeroed statistics for the trees of an ensemble.
+ **/
+vote_stats_t* vote_stats_new(const vote_ensemble_t *f);
+
+
+/**
+ * Delete statistics.
+ **/
+void vote_stats_del(vote_stats_t *s);
+
+
+/**
+ * Get the number of threads used by a plan.
+ **/
+size_t vote_plan_size(const vote_plan_t *p);
+
+
+/**
+ * Get the number of tasks carried out by each thread during the last run of
+ * a plan. The array must have room for vote_plan_size() elements.
+ **/
+void vote_plan_tasks(const vote_plan_t *p, size_t *nb_tasks);
+
+
 /**
  * Approximate a pessimistic and sound mapping for a given input region.
  **/
@@ -292,4 +714,82 @@ vote_mapping_t *vote_ensemble_approximate(const vote_ensemble_t *f,
 					  const vote_bound_t* input_region);
 
 
+/**
+ * Approximate a sound mapping for a given input region that is at least as
+ * tight as vote_ensemble_approximate(), by refining the regions with the
+ * widest output bounds first until a budget of refined regions or seconds is
+ * exhausted, or the mapping is exact. A zero budget is unlimited. The output
+ * bounds are post-processed.
+ *
+ * At most 65536 regions are kept open for refinement. Regions beyond that are
+ * joined into the mapping unrefined, so the mapping may not be exact even with
+ * an unlimited budget.
+ **/
+vote_mapping_t *vote_ensemble_approximate_anytime(const vote_ensemble_t *f,
+						  const vote_bound_t* input_region,
+						  size_t max_nodes,
+						  double max_seconds);
+
+
+/**
+ * Compute the largest value of an output of an ensemble in an input region
+ * with a best-first branch-and-bound, where the abstraction of the trees that
+ * remain to be refined bounds the value in each region of the search. If
+ * non-NULL, the witness receives an input region where the value is attained.
+ *
+ * Returns true if the best value is the exact maximum, and false if the input
+ * region is empty, in which case the best value is -VOTE_INFINITY (or
+ * VOTE_INFINITY when minimizing) and the witness is left untouched.
+ **/
+bool vote_ensemble_maximize(const vote_ensemble_t *f,
+			    const vote_bound_t* input_region, size_t output,
+			    real_t *best, vote_bound_t *witness);
+
+
+/**
+ * Compute the smallest value of an output of an ensemble in an input region,
+ * see vote_ensemble_maximize().
+ **/
+bool vote_ensemble_minimize(const vote_ensemble_t *f,
+			    const vote_bound_t* input_region, size_t output,
+			    real_t *best, vote_bound_t *witness);
+
+
+/**
+ * Maximize an output of an ensemble, see vote_ensemble_maximize(), and
+ * report the gap between the best value attained so far and the bound on the
+ * maximum to a callback while searching. When the callback stops the search,
+ * the best value attained so far is returned.
+ *
+ * Returns true if the best value is the exact maximum.
+ **/
+bool vote_ensemble_maximize_anytime(const vote_ensemble_t *f,
+				    const vote_bound_t* input_region,
+				    size_t output, real_t *best,
+				    vote_bound_t *witness,
+				    vote_progress_cb_t *cb, void *ctx);
+
+
+/**
+ * Minimize an output of an ensemble, see vote_ensemble_maximize_anytime().
+ **/
+bool vote_ensemble_minimize_anytime(const vote_ensemble_t *f,
+				    const vote_bound_t* input_region,
+				    size_t output, real_t *best,
+				    vote_bound_t *witness,
+				    vote_progress_cb_t *cb, void *ctx);
+
+
+/**
+ * Write the spans that the stages of the pipeline (abstraction, refinement,
+ * post-processing and the user callback) recorded on each thread to a file in
+ * the Chrome trace event format. Only the most recent spans of each thread are
+ * kept. Must not be called while an analysis is running.
+ *
+ * Returns false if the library was configured without --enable-tracing, or if
+ * the file could not be written.
+ **/
+bool vote_trace_dump(const char *filename);
+
+
 #endif //VOTE_H
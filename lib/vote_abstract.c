@@ -23,7 +23,47 @@ see <http://www.gnu.org/licenses/>.  */
 #include "vote.h"
 #include "vote_pipeline.h"
 #include "vote_abstract.h"
+#include "vote_workpool.h"
+#include "vote_budget.h"
+#include "vote_stats.h"
+#include "vote_bitvector.h"
 #include "vote_math.h"
+#include "vote_trace.h"
+
+
+/**
+ * The input region of the most recent join, together with the join of each
+ * tree for that region. Trees that do not test any of the inputs that changed
+ * since then need not be joined again. With the difference domain, the joins
+ * of the differences between a reference output and every output are kept as
+ * well. The cache also keeps track of how often the suffix bounds suffice.
+ **/
+typedef struct vote_abstract_cache {
+  vote_bound_t *inputs;
+  vote_bound_t *outputs;
+  bool         *dirty;
+  size_t        nb_joins;
+  vote_bound_t *differences;
+  vote_bound_t *tree_differences;
+  size_t        reference;
+  size_t        nb_tries;
+  size_t        nb_hits;
+  size_t        nb_skips;
+} vote_abstract_cache_t;
+
+
+/**
+ * The trees testing input i are trees[offset[i]] ... trees[offset[i+1]-1],
+ * in ascending order.
+ **/
+struct vote_abstract_index {
+  vote_tree_t *const*base;
+  size_t             nb_trees;
+  size_t             nb_inputs;
+  size_t            *offset;
+  size_t            *trees;
+  size_t             nb_refs;
+};
 
 
 /**
@@ -34,45 +74,100 @@ typedef struct vote_abstract {
   size_t                 nb_trees;
   const vote_pipeline_t *pipeline;
   const vote_pipeline_t *postproc;
+  const vote_pipeline_t *refinery;
+  vote_workpool_t       *pool;
+  vote_budget_t         *budget;
+  vote_counters_t       *counters;
+  vote_abstract_index_t *index;
+  size_t                 first;
+  bool                   relational;
+  const vote_bound_t    *suffix;
+
+  // one cache per worker
+  size_t                 nb_caches;
+  vote_abstract_cache_t  caches[];
 } vote_abstract_t;
 
 
+/**
+ * Check if an input region contains the threshold hulls of an internal node,
+ * i.e. if every leaf below the node is reachable from the region.
+ **/
+static inline bool
+vote_abstract_contains(const vote_tree_t *t, size_t node_id,
+		       const vote_bound_t *inputs) {
+  const vote_hull_t *hulls = vote_node_hulls(t, node_id);
+  size_t nb_hulls = vote_node_nb_hulls(t, node_id);
+
+  for(size_t i=0; i<nb_hulls; i++) {
+    const vote_bound_t *b = &inputs[hulls[i].feature];
+    if(b->lower > hulls[i].lower || b->upper <= hulls[i].upper) {
+      return false;
+    }
+  }
+  
+  return true;
+}
+
+
+/**
+ * Check if both children of an internal node are reachable from an input
+ * region.
+ **/
+static inline bool
+vote_abstract_straddles(const vote_node_t *n, const vote_bound_t *inputs) {
+  return !vote_node_is_leaf(n) &&
+    inputs[n->feature].lower <= n->threshold &&
+    inputs[n->feature].upper > n->threshold;
+}
+
+
 static void
 vote_abstract_join_decend_tree(const vote_tree_t *t, size_t node_id,
 			       const vote_bound_t *inputs, size_t nb_inputs,
-			       vote_bound_t *outputs, size_t nb_outputs) {
-  int left_id = t->left[node_id];
-  int right_id = t->right[node_id];
-  real_t value[nb_outputs];
+			       vote_bound_t *outputs) {
+  const vote_node_t *n = &t->nodes[node_id];
     
-  if(left_id < 0 || right_id < 0) {
-    memcpy(value, t->value[node_id], nb_outputs * sizeof(real_t));
-    if(t->normalize) {
-      vote_normalize(value, nb_outputs);
-    }
+  if(vote_node_is_leaf(n)) {
+    const real_t *value = vote_node_value(t, n);
   
-    for(size_t i=0; i<nb_outputs; i++) {
+    for(size_t i=0; i<t->nb_values; i++) {
       outputs[i].lower = vote_min(value[i], outputs[i].lower);
       outputs[i].upper = vote_max(value[i], outputs[i].upper);
     }
     return;
   }
 
-  real_t threshold = t->threshold[node_id];
-  int dim = t->feature[node_id];
+  real_t threshold = n->threshold;
+  int dim = n->feature;
+  bool left = inputs[dim].lower <= threshold;
+  bool right = inputs[dim].upper > threshold;
+
+  // every leaf below is reachable, use the precomputed join. The children
+  // must be internal nodes that are split by the region for this to pay off.
+  if(left && right &&
+     vote_abstract_straddles(&t->nodes[n->child], inputs) &&
+     vote_abstract_straddles(&t->nodes[n->child + 1], inputs) &&
+     vote_abstract_contains(t, node_id, inputs)) {
+    const vote_bound_t *join = vote_node_join(t, node_id);
     
+    for(size_t i=0; i<t->nb_values; i++) {
+      outputs[i].lower = vote_min(join[i].lower, outputs[i].lower);
+      outputs[i].upper = vote_max(join[i].upper, outputs[i].upper);
+    }
+    return;
+  }
+  
   // left: [lower, threshold]
-  if(inputs[dim].lower <= threshold) {
-    vote_abstract_join_decend_tree(t, left_id,
-				   inputs, nb_inputs,
-				   outputs, nb_outputs);
+  if(left) {
+    vote_abstract_join_decend_tree(t, (size_t)n->child,
+				   inputs, nb_inputs, outputs);
   }
 
   // right: (threshold, upper]
-  if(inputs[dim].upper > threshold) {
-    vote_abstract_join_decend_tree(t, right_id,
-				   inputs, nb_inputs,
-				   outputs, nb_outputs);
+  if(right) {
+    vote_abstract_join_decend_tree(t, (size_t)n->child + 1,
+				   inputs, nb_inputs, outputs);
   }
 }
 
@@ -80,15 +175,20 @@ vote_abstract_join_decend_tree(const vote_tree_t *t, size_t node_id,
 void
 vote_abstract_join_tree(const vote_tree_t *t,
 			const vote_bound_t *inputs, size_t nb_inputs,
-			vote_bound_t *outputs, size_t nb_outputs) {
+			vote_bound_t *outputs) {
   const size_t root_id = 0;
+
+  if(t->bitvector) {
+    vote_bitvector_join(t, t->bitvector, inputs, outputs);
+    return;
+  }
   
-  for(size_t i=0; i<t->nb_outputs; i++) {
+  for(size_t i=0; i<t->nb_values; i++) {
     outputs[i].lower = VOTE_INFINITY;
     outputs[i].upper = -VOTE_INFINITY;
   }
 
-  vote_abstract_join_decend_tree(t, root_id, inputs, nb_inputs, outputs, nb_outputs);
+  vote_abstract_join_decend_tree(t, root_id, inputs, nb_inputs, outputs);
 }
 
 
@@ -98,15 +198,363 @@ vote_abstract_join_trees(vote_tree_t *const*trees, size_t nb_trees,
 			 vote_bound_t *outputs, size_t nb_outputs) {
   vote_bound_t tree_outputs[nb_outputs];
   
-  for(size_t i=0; i<nb_trees; i++) {    
-    vote_abstract_join_tree(trees[i], inputs, nb_inputs,
-			    tree_outputs, nb_outputs);
+  for(size_t i=0; i<nb_trees; i++) {
+    const vote_tree_t *t = trees[i];
+    vote_bound_t *sum = &outputs[t->output];
+    
+    vote_abstract_join_tree(t, inputs, nb_inputs, tree_outputs);
+
+    for(size_t dim=0; dim<t->nb_values; dim++) {
+      sum[dim].lower += tree_outputs[dim].lower;
+      sum[dim].upper += tree_outputs[dim].upper;
+    }
+  }
+}
+
+
+vote_abstract_index_t*
+vote_abstract_index_new(vote_tree_t *const*trees, size_t nb_trees) {
+  vote_abstract_index_t *index;
+  bool incremental = false;
+
+  // caching is futile when every tree tests every input
+  for(size_t i=0; i<nb_trees; i++) {
+    incremental |= trees[i]->nb_features < trees[i]->nb_inputs;
+  }
+
+  if(!incremental) {
+    return NULL;
+  }
+
+  index = calloc(1, sizeof(vote_abstract_index_t));
+  assert(index);
+  
+  index->base = trees;
+  index->nb_trees = nb_trees;
+  index->nb_inputs = trees[0]->nb_inputs;
+  index->nb_refs = 1;
+  
+  index->offset = calloc(index->nb_inputs + 1, sizeof(size_t));
+  assert(index->offset);
+  
+  for(size_t i=0; i<nb_trees; i++) {
+    for(size_t j=0; j<trees[i]->nb_features; j++) {
+      index->offset[trees[i]->features[j] + 1]++;
+    }
+  }
+
+  for(size_t i=0; i<index->nb_inputs; i++) {
+    index->offset[i + 1] += index->offset[i];
+  }
+
+  index->trees = calloc(index->offset[index->nb_inputs] + 1, sizeof(size_t));
+  assert(index->trees);
+
+  size_t fill[index->nb_inputs + 1];
+  memcpy(fill, index->offset, sizeof(fill));
+  
+  for(size_t i=0; i<nb_trees; i++) {
+    for(size_t j=0; j<trees[i]->nb_features; j++) {
+      index->trees[fill[trees[i]->features[j]]++] = i;
+    }
+  }
+
+  return index;
+}
+
+
+void
+vote_abstract_index_del(vote_abstract_index_t *index) {
+  if(!index || --index->nb_refs) {
+    return;
+  }
+  
+  free(index->offset);
+  free(index->trees);
+  free(index);
+}
+
+
+/**
+ * Record the input region of a join, and mark the trees that test inputs which
+ * differ from the previous join as dirty.
+ **/
+static void
+vote_abstract_cache_update(const vote_abstract_t *a, vote_abstract_cache_t *c,
+			   const vote_bound_t *inputs) {
+  const vote_abstract_index_t *index = a->index;
+  const size_t nb_inputs = index->nb_inputs;
+  const size_t nb_outputs = a->trees[0]->nb_outputs;
+  const size_t first = a->first;
+  const size_t last = a->first + a->nb_trees;
+  
+  if(!c->inputs) {
+    c->inputs = calloc(nb_inputs, sizeof(vote_bound_t));
+    assert(c->inputs);
+
+    c->outputs = calloc(a->nb_trees * nb_outputs, sizeof(vote_bound_t));
+    assert(c->outputs);
+
+    c->dirty = calloc(a->nb_trees, sizeof(bool));
+    assert(c->dirty);
+
+    memset(c->dirty, true, a->nb_trees * sizeof(bool));
+    
+  } else {
+    for(size_t i=0; i<nb_inputs; i++) {
+      if(inputs[i].lower == c->inputs[i].lower &&
+	 inputs[i].upper == c->inputs[i].upper) {
+	continue;
+      }
+      for(size_t j=index->offset[i + 1]; j>index->offset[i]; j--) {
+	size_t tree_id = index->trees[j - 1];
+	if(tree_id < first) {
+	  break;
+	}
+	if(tree_id < last) {
+	  c->dirty[tree_id - first] = true;
+	}
+      }
+    }
+  }
+
+  memcpy(c->inputs, inputs, nb_inputs * sizeof(vote_bound_t));
+}
+
+
+/**
+ * Compute the join of all trees in an abstraction component, re-joining only
+ * the trees that test inputs which differ from the previous join.
+ **/
+static void
+vote_abstract_join_cached(const vote_abstract_t *a, vote_abstract_cache_t *c,
+			  const vote_bound_t *inputs, vote_bound_t *outputs) {
+  const size_t nb_inputs = a->index->nb_inputs;
+  const size_t nb_outputs = a->trees[0]->nb_outputs;
+
+  vote_abstract_cache_update(a, c, inputs);
+  
+  for(size_t i=0; i<a->nb_trees; i++) {
+    const vote_tree_t *t = a->trees[i];
+    vote_bound_t *tree_outputs = &c->outputs[i * nb_outputs];
+    vote_bound_t *sum = &outputs[t->output];
+    
+    if(c->dirty[i]) {
+      vote_abstract_join_tree(t, inputs, nb_inputs, tree_outputs);
+      c->dirty[i] = false;
+    }
+    
+    for(size_t dim=0; dim<t->nb_values; dim++) {
+      sum[dim].lower += tree_outputs[dim].lower;
+      sum[dim].upper += tree_outputs[dim].upper;
+    }
+  }
+}
+
+
+/**
+ * Join the differences outputs[reference] - outputs[i] of the leaves below a
+ * node that are reachable from an input region.
+ **/
+static void
+vote_abstract_relate_decend_tree(const vote_tree_t *t, size_t node_id,
+				 const vote_bound_t *inputs, size_t reference,
+				 vote_bound_t *differences) {
+  const vote_node_t *n = &t->nodes[node_id];
+
+  if(vote_node_is_leaf(n)) {
+    const real_t *value = vote_node_value(t, n);
+
+    for(size_t i=0; i<t->nb_values; i++) {
+      real_t d = value[reference] - value[i];
+      differences[i].lower = vote_min(d, differences[i].lower);
+      differences[i].upper = vote_max(d, differences[i].upper);
+    }
+    return;
+  }
+
+  // left: [lower, threshold]
+  if(inputs[n->feature].lower <= n->threshold) {
+    vote_abstract_relate_decend_tree(t, (size_t)n->child, inputs,
+				     reference, differences);
+  }
+
+  // right: (threshold, upper]
+  if(inputs[n->feature].upper > n->threshold) {
+    vote_abstract_relate_decend_tree(t, (size_t)n->child + 1, inputs,
+				     reference, differences);
+  }
+}
+
+
+/**
+ * Compute the join of the differences outputs[reference] - outputs[i] of the
+ * leaves of a tree that contributes to every output.
+ **/
+static void
+vote_abstract_relate_tree(const vote_tree_t *t, const vote_bound_t *inputs,
+			  size_t reference, vote_bound_t *differences) {
+  for(size_t i=0; i<t->nb_values; i++) {
+    differences[i].lower = VOTE_INFINITY;
+    differences[i].upper = -VOTE_INFINITY;
+  }
+
+  vote_abstract_relate_decend_tree(t, 0, inputs, reference, differences);
+}
+
+
+/**
+ * Compute the join of all trees in an abstraction component, and bound the
+ * differences between the output with the largest lower bound, and every
+ * other output. Trees that contribute to every output bound the differences
+ * leaf by leaf, which captures outputs that are correlated within the tree,
+ * while the remaining trees, and the outputs of the mapping, only contribute
+ * with differences between intervals. Like other joins, trees are only
+ * re-joined when their inputs, or the reference output, change if the
+ * component has an index.
+ **/
+static void
+vote_abstract_join_differences(const vote_abstract_t *a,
+			       vote_abstract_cache_t *c,
+			       const vote_bound_t *inputs, size_t nb_inputs,
+			       vote_bound_t *outputs, size_t nb_outputs) {
+  vote_bound_t related[nb_outputs];
+  size_t reference = 0;
+  bool moved;
+
+  if(!c->differences) {
+    c->differences = calloc(nb_outputs, sizeof(vote_bound_t));
+    assert(c->differences);
+
+    c->tree_differences = calloc(a->nb_trees * nb_outputs,
+				 sizeof(vote_bound_t));
+    assert(c->tree_differences);
+  }
+
+  if(a->index) {
+    vote_abstract_cache_update(a, c, inputs);
+  } else {
+    if(!c->dirty) {
+      c->outputs = calloc(a->nb_trees * nb_outputs, sizeof(vote_bound_t));
+      assert(c->outputs);
+
+      c->dirty = calloc(a->nb_trees, sizeof(bool));
+      assert(c->dirty);
+    }
+    memset(c->dirty, true, a->nb_trees * sizeof(bool));
+  }
+
+  // join each tree, keeping the trees that contribute to every output apart
+  memset(related, 0, sizeof(related));
+  
+  for(size_t i=0; i<a->nb_trees; i++) {
+    const vote_tree_t *t = a->trees[i];
+    vote_bound_t *tree_outputs = &c->outputs[i * nb_outputs];
+    vote_bound_t *sum = t->nb_values < nb_outputs ? &outputs[t->output] : related;
 
-    for(size_t dim=0; dim<nb_outputs; dim++) {
-      outputs[dim].lower += tree_outputs[dim].lower;
-      outputs[dim].upper += tree_outputs[dim].upper;
+    if(c->dirty[i]) {
+      vote_abstract_join_tree(t, inputs, nb_inputs, tree_outputs);
+    }
+    for(size_t dim=0; dim<t->nb_values; dim++) {
+      sum[dim].lower += tree_outputs[dim].lower;
+      sum[dim].upper += tree_outputs[dim].upper;
+    }
+  }
+
+  for(size_t i=1; i<nb_outputs; i++) {
+    if(outputs[i].lower + related[i].lower >
+       outputs[reference].lower + related[reference].lower) {
+      reference = i;
+    }
+  }
+
+  moved = c->nb_joins++ && reference != c->reference;
+  c->reference = reference;
+
+  // relate the remaining outputs to the reference, leaf by leaf
+  for(size_t i=0; i<nb_outputs; i++) {
+    c->differences[i].lower = outputs[reference].lower - outputs[i].upper;
+    c->differences[i].upper = outputs[reference].upper - outputs[i].lower;
+  }
+  
+  for(size_t i=0; i<a->nb_trees; i++) {
+    const vote_tree_t *t = a->trees[i];
+    vote_bound_t *tree_differences = &c->tree_differences[i * nb_outputs];
+    
+    if(t->nb_values == nb_outputs) {
+      if(c->dirty[i] || moved) {
+	vote_abstract_relate_tree(t, inputs, reference, tree_differences);
+      }
+      for(size_t dim=0; dim<nb_outputs; dim++) {
+	c->differences[dim].lower += tree_differences[dim].lower;
+	c->differences[dim].upper += tree_differences[dim].upper;
+      }
     }
+    c->dirty[i] = false;
   }
+
+  for(size_t i=0; i<nb_outputs; i++) {
+    outputs[i].lower += related[i].lower;
+    outputs[i].upper += related[i].upper;
+  }
+}
+
+
+/**
+ * Check if a mapping is worth deciding with the suffix bounds, i.e. if at
+ * least one in eight attempts has passed. Otherwise, only probe every eighth
+ * mapping in case the mappings have become easier to decide.
+ **/
+static bool
+vote_abstract_try_suffix(vote_abstract_cache_t *c) {
+  return c->nb_hits * 8 >= c->nb_tries || !(++c->nb_skips % 8);
+}
+
+
+/**
+ * Check if the first tree of an abstraction component only contributes to a
+ * class that can no longer be the argmax, i.e. if the bound of some other
+ * class lies strictly above the bound of that class.
+ **/
+static bool
+vote_abstract_settled(const vote_abstract_t *a, const vote_bound_t *outputs,
+		      size_t nb_outputs) {
+  const vote_tree_t *t = a->trees[0];
+
+  if(t->nb_values != 1) {
+    return false;
+  }
+
+  for(size_t i=0; i<nb_outputs; i++) {
+    if(outputs[i].lower > outputs[t->output].upper) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+/**
+ * Pass a mapping on to the element that succeeds the refinery of the first
+ * tree, with the join of that tree added to the class it contributes to.
+ **/
+static vote_outcome_t
+vote_abstract_bypass(const vote_abstract_t *a, vote_mapping_t *m) {
+  const vote_tree_t *t = a->trees[0];
+  vote_bound_t *sum = &m->outputs[t->output];
+  vote_bound_t trail = *sum;
+  vote_bound_t join;
+  vote_outcome_t o;
+
+  vote_abstract_join_tree(t, m->inputs, m->nb_inputs, &join);
+  sum->lower += join.lower;
+  sum->upper += join.upper;
+
+  o = vote_pipeline_output(a->refinery, m);
+  *sum = trail;
+
+  return o;
 }
 
 
@@ -114,8 +562,12 @@ vote_abstract_join_trees(vote_tree_t *const*trees, size_t nb_trees,
  * Apply the abstraction algorithm on a mapping.
  **/
 static vote_outcome_t
-vote_abstract_input(void *ctx, vote_mapping_t *m) {
+vote_abstract_apply(void *ctx, vote_mapping_t *m) {
   vote_abstract_t *a = (vote_abstract_t*)ctx;
+  vote_abstract_cache_t *c = &a->caches[a->pool ? vote_workpool_worker(a->pool) : 0];
+  vote_tree_stats_t scratch = {0};
+  vote_tree_stats_t *s = a->counters ?
+    vote_counters_local(a->counters, a->pool) : &scratch;
   vote_bound_t outputs[m->nb_outputs];
   vote_mapping_t join = {
     .inputs = m->inputs,
@@ -124,33 +576,138 @@ vote_abstract_input(void *ctx, vote_mapping_t *m) {
     .nb_outputs = m->nb_outputs
   };
 
+  // some other worker found a counterexample, stop
+  if(a->pool && vote_workpool_cancelled(a->pool)) {
+    return VOTE_FAIL;
+  }
+
+  // out of time, stop before joining the trees
+  if(a->budget && !vote_budget_poll(a->budget, a->pool)) {
+    return VOTE_FAIL;
+  }
+
+  s->nb_abstracted++;
+
+  // the trees stay within their bounds over the whole query region, which
+  // may already suffice to pass the mapping
+  if(a->suffix && vote_abstract_try_suffix(c)) {
+    for(size_t i=0; i<m->nb_outputs; i++) {
+      outputs[i].lower = m->outputs[i].lower + a->suffix[i].lower;
+      outputs[i].upper = m->outputs[i].upper + a->suffix[i].upper;
+    }
+    c->nb_tries++;
+    if(vote_pipeline_input(a->postproc, &join) == VOTE_PASS) {
+      c->nb_hits++;
+      s->nb_settled++;
+      return VOTE_PASS;
+    }
+  }
+  
   memcpy(outputs, m->outputs, m->nb_outputs * sizeof(vote_bound_t));
-  vote_abstract_join_trees(a->trees, a->nb_trees, m->inputs, m->nb_inputs,
-			   outputs, m->nb_outputs);
+  // most components only see a single mapping, do not bother caching those
+  if(a->relational) {
+    vote_abstract_join_differences(a, c, m->inputs, m->nb_inputs,
+				   outputs, m->nb_outputs);
+    join.differences = c->differences;
+    join.reference = c->reference;
+  } else if(a->index && c->nb_joins++) {
+    vote_abstract_join_cached(a, c, m->inputs, outputs);
+  } else {
+    vote_abstract_join_trees(a->trees, a->nb_trees, m->inputs, m->nb_inputs,
+			     outputs, m->nb_outputs);
+  }
   
   vote_outcome_t o = vote_pipeline_input(a->postproc, &join);
 
-  if(o == VOTE_UNSURE) {
-    return vote_pipeline_output(a->pipeline, m);
+  if(o != VOTE_UNSURE) {
+    s->nb_settled++;
+    return o;
   }
 
+  // further refinement only narrows the bounds, so the class of the first
+  // tree stays below the other one, and refining the tree is futile
+  if(a->refinery && vote_abstract_settled(a, outputs, m->nb_outputs)) {
+    s->nb_bypassed++;
+    return vote_abstract_bypass(a, m);
+  }
+
+  s->nb_refined++;
+  return vote_pipeline_output(a->pipeline, m);
+}
+
+
+/**
+ * Apply the abstraction algorithm on a mapping, traced as a stage of the
+ * pipeline together with the stages that succeed it.
+ **/
+static vote_outcome_t
+vote_abstract_input(void *ctx, vote_mapping_t *m) {
+  vote_outcome_t o;
+
+  VOTE_TRACE(VOTE_TRACE_ABSTRACT, o = vote_abstract_apply(ctx, m));
+
   return o;
 }
 
 
+/**
+ * Delete an abstraction component and its caches.
+ **/
+static void
+vote_abstract_del(void *ctx) {
+  vote_abstract_t *a = (vote_abstract_t*)ctx;
+
+  for(size_t i=0; i<a->nb_caches; i++) {
+    free(a->caches[i].inputs);
+    free(a->caches[i].outputs);
+    free(a->caches[i].dirty);
+    free(a->caches[i].differences);
+    free(a->caches[i].tree_differences);
+  }
+
+  vote_abstract_index_del(a->index);
+  free(a);
+}
+
+
 vote_pipeline_t*
 vote_abstract_pipeline(vote_tree_t *const*trees, size_t nb_trees,
-		       const vote_pipeline_t *postproc) {
-  vote_abstract_t *a = calloc(1, sizeof(vote_abstract_t));
-  vote_pipeline_t *p = vote_pipeline_new(a, vote_abstract_input, free);
+		       vote_abstract_index_t *index, vote_domain_t domain,
+		       const vote_bound_t *suffix,
+		       const vote_pipeline_t *postproc,
+		       const vote_pipeline_t *refinery, vote_workpool_t *pool,
+		       vote_budget_t *budget, vote_counters_t *counters) {
+  size_t nb_caches = pool ? vote_workpool_size(pool) : 1;
+  vote_abstract_t *a = calloc(1, sizeof(vote_abstract_t) +
+			      nb_caches * sizeof(vote_abstract_cache_t));
+  vote_pipeline_t *p = vote_pipeline_new(a, vote_abstract_input,
+					 vote_abstract_del);
   
   assert(a);
 
-  a->trees    = trees;
-  a->nb_trees = nb_trees;
-  a->pipeline = p;
-  a->postproc = postproc;
+  a->trees     = trees;
+  a->nb_trees  = nb_trees;
+  a->pipeline  = p;
+  a->postproc  = postproc;
+  a->refinery  = refinery;
+  a->pool      = pool;
+  a->budget    = budget;
+  a->counters  = counters;
+  a->suffix    = suffix;
+  a->nb_caches = nb_caches;
+
+  // differences are only defined between several outputs
+  a->relational = (domain == VOTE_DOMAIN_DIFFERENCE &&
+		   nb_trees && trees[0]->nb_outputs > 1);
+
+  if(index) {
+    assert(trees >= index->base);
+    assert(trees + nb_trees <= index->base + index->nb_trees);
+    
+    a->index = index;
+    a->first = (size_t)(trees - index->base);
+    index->nb_refs++;
+  }
   
   return p;
 }
-
@@ -23,14 +23,18 @@ see <http://www.gnu.org/licenses/>.  */
 #include "vote.h"
 #include "vote_tree.h"
 #include "vote_pipeline.h"
+#include "vote_workpool.h"
+#include "vote_budget.h"
+#include "vote_stats.h"
 
 
 /**
- * Compute the join of a tree for a particular input region.
+ * Compute the join of a tree for a particular input region, i.e. of the
+ * nb_values outputs of the tree starting at its output.
  **/
 void vote_abstract_join_tree(const vote_tree_t *t,
 			     const vote_bound_t *inputs, size_t nb_inputs,
-			     vote_bound_t *outputs, size_t nb_outputs);
+			     vote_bound_t *outputs);
 
 
 /**
@@ -43,10 +47,66 @@ vote_abstract_join_trees(vote_tree_t *const*trees, size_t nb_trees,
 
 
 /**
+ * An index of the trees in an ensemble by the inputs they test.
+ **/
+typedef struct vote_abstract_index vote_abstract_index_t;
+
+
+/**
+ * Index a set of trees by the inputs they test. Returns NULL if every tree
+ * tests every input, in which case there is nothing to gain from an index.
+ **/
+vote_abstract_index_t* vote_abstract_index_new(vote_tree_t *const*trees,
+					       size_t nb_trees);
+
+
+/**
+ * Release an index. The index is deleted once all abstraction components
+ * that use it have been deleted as well.
+ **/
+void vote_abstract_index_del(vote_abstract_index_t *index);
+
+
+/**
+ * Create an abstraction component for a pipeline. Mappings that cannot be
+ * decided by the postproc component are passed on to the next component. If a
+ * pool is given, the component stops when the pool is cancelled.
+ *
+ * If an index that covers the trees is given, the component caches the join
+ * of each tree, and only joins trees that test inputs that differ from the
+ * previous mapping it processed.
+ *
+ * If the refinery of the first tree is given, the component operates on each
+ * class independently. When the first tree only contributes to a class with a
+ * bound that lies strictly below the bound of some other class, the join of
+ * the tree is added to that class, and the mapping bypasses the refinery.
+ * Mappings that leave the pipeline are then only precise in the classes that
+ * may still be the argmax, which suffices for postproc components that decide
+ * on the argmax and preserve the order of class bounds.
+ *
+ * With the difference domain, the mappings passed to the postproc component
+ * also bound the differences between a reference output and every output.
+ *
+ * If suffix bounds are given, i.e. the sum of the joins of the trees over an
+ * input region that contains every mapping the component processes, the
+ * component first tries to decide mappings with those. Only mappings the
+ * postproc component cannot pass that way are joined with the trees. The
+ * bounds are read when mappings are processed, so they may be updated
+ * between runs of the pipeline.
  *
+ * If a budget is given, the component stops processing mappings once its
+ * deadline has passed or it has been cancelled. If counters are given, the
+ * component counts the mappings it processes, and how it disposes of them.
  **/
 vote_pipeline_t* vote_abstract_pipeline(vote_tree_t *const*trees, size_t nb_trees,
-					const vote_pipeline_t *postproc);
+					vote_abstract_index_t *index,
+					vote_domain_t domain,
+					const vote_bound_t *suffix,
+					const vote_pipeline_t *postproc,
+					const vote_pipeline_t *refinery,
+					vote_workpool_t *pool,
+					vote_budget_t *budget,
+					vote_counters_t *counters);
   
 
 #endif //VOTE_ABSTRACT_H
@@ -0,0 +1,338 @@
+/* Copyright (C) 2021 John Törnblom
+
+   This file is part of VoTE (Verifier of Tree Ensembles).
+
+VoTE is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+VoTE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or
+FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with VoTE; see the files COPYING and COPYING.LESSER. If not,
+see <http://www.gnu.org/licenses/>.  */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vote.h"
+#include "vote_tree.h"
+#include "vote_bitvector.h"
+#include "vote_math.h"
+
+
+#define VOTE_WORD_BITS 64
+
+
+/**
+ * The split of an internal node, and the leaves below its children, i.e.
+ * leaves [begin, middle) to the left and [middle, end) to the right.
+ **/
+typedef struct vote_split {
+  real_t   threshold;
+  uint32_t begin;
+  uint32_t middle;
+  uint32_t end;
+} vote_split_t;
+
+
+/**
+ * Thresholds are grouped by the features tested by the tree, in the same
+ * order as tree->features, and sorted within each group. The thresholds of
+ * the i:th feature are thresholds[offset[i]] ... thresholds[offset[i+1]-1].
+ *
+ * The k:th left mask of a feature holds the leaves that remain reachable when
+ * the k+1 smallest thresholds are below the lower bound of a region, and the
+ * k:th right mask those that remain when the k+1 largest thresholds are at
+ * least the upper bound.
+ **/
+struct vote_bitvector {
+  real_t   *thresholds;
+  uint64_t *left;
+  uint64_t *right;
+  size_t   *offset;
+  size_t    nb_words;
+};
+
+
+/**
+ * Order splits by threshold.
+ **/
+static int
+vote_split_cmp(const void *a, const void *b) {
+  const vote_split_t *sa = (const vote_split_t*)a;
+  const vote_split_t *sb = (const vote_split_t*)b;
+
+  return (sa->threshold > sb->threshold) - (sa->threshold < sb->threshold);
+}
+
+
+/**
+ * Clear the bits [begin, end) of a bitvector.
+ **/
+static inline void
+vote_bitvector_clear(uint64_t *words, size_t begin, size_t end) {
+  size_t first = begin / VOTE_WORD_BITS;
+  size_t last = (end - 1) / VOTE_WORD_BITS;
+  uint64_t head = ~UINT64_C(0) << (begin % VOTE_WORD_BITS);
+  uint64_t tail = ~UINT64_C(0) >> (VOTE_WORD_BITS - 1 - (end - 1) % VOTE_WORD_BITS);
+
+  if(first == last) {
+    words[first] &= ~(head & tail);
+    return;
+  }
+
+  words[first] &= ~head;
+  for(size_t i=first+1; i<last; i++) {
+    words[i] = 0;
+  }
+  words[last] &= ~tail;
+}
+
+
+/**
+ * Copy a bitvector, or set all of its bits if there is nothing to copy.
+ **/
+static inline void
+vote_bitvector_fill(uint64_t *words, size_t nb_words, const uint64_t *source) {
+  if(source) {
+    memcpy(words, source, nb_words * sizeof(uint64_t));
+  } else {
+    memset(words, 0xff, nb_words * sizeof(uint64_t));
+  }
+}
+
+
+/**
+ * Collect the splits below a packed node, and return the range of leaves
+ * below it.
+ **/
+static void
+vote_bitvector_split(const vote_tree_t *t, size_t node_id, size_t *slot,
+		     vote_split_t *splits, uint32_t *begin, uint32_t *end) {
+  const vote_node_t *n = &t->nodes[node_id];
+  uint32_t middle;
+  
+  if(vote_node_is_leaf(n)) {
+    *begin = (uint32_t)n->child;
+    *end = *begin + 1;
+    return;
+  }
+
+  vote_bitvector_split(t, (size_t)n->child, slot, splits, begin, &middle);
+  vote_bitvector_split(t, (size_t)n->child + 1, slot, splits, &middle, end);
+
+  vote_split_t *s = &splits[slot[n->feature]++];
+  s->threshold = n->threshold;
+  s->begin = *begin;
+  s->middle = middle;
+  s->end = *end;
+}
+
+
+vote_bitvector_t*
+vote_bitvector_new(const vote_tree_t *t) {
+  size_t nb_splits = t->nb_nodes - t->nb_leaves;
+  vote_bitvector_t *bv = calloc(1, sizeof(vote_bitvector_t));
+  vote_split_t *splits = calloc(nb_splits + 1, sizeof(vote_split_t));
+  size_t *slot = calloc(t->nb_inputs + 1, sizeof(size_t));
+  uint32_t begin, end;
+  
+  assert(bv);
+  assert(splits);
+  assert(slot);
+
+  bv->nb_words = (t->nb_leaves + VOTE_WORD_BITS - 1) / VOTE_WORD_BITS;
+  
+  bv->offset = calloc(t->nb_features + 1, sizeof(size_t));
+  assert(bv->offset);
+
+  bv->thresholds = calloc(nb_splits + 1, sizeof(real_t));
+  assert(bv->thresholds);
+
+  bv->left = calloc(nb_splits * bv->nb_words + 1, sizeof(uint64_t));
+  assert(bv->left);
+
+  bv->right = calloc(nb_splits * bv->nb_words + 1, sizeof(uint64_t));
+  assert(bv->right);
+  
+  for(size_t i=0; i<t->nb_nodes; i++) {
+    if(!vote_node_is_leaf(&t->nodes[i])) {
+      slot[t->nodes[i].feature]++;
+    }
+  }
+
+  for(size_t i=0; i<t->nb_features; i++) {
+    size_t nb_feature_splits = slot[t->features[i]];
+    slot[t->features[i]] = bv->offset[i];
+    bv->offset[i + 1] = bv->offset[i] + nb_feature_splits;
+  }
+
+  vote_bitvector_split(t, 0, slot, splits, &begin, &end);
+  assert(begin == 0 && end == t->nb_leaves);
+  
+  for(size_t i=0; i<t->nb_features; i++) {
+    size_t first = bv->offset[i];
+    size_t n = bv->offset[i + 1] - first;
+    uint64_t *left = &bv->left[first * bv->nb_words];
+    uint64_t *right = &bv->right[first * bv->nb_words];
+    
+    qsort(&splits[first], n, sizeof(vote_split_t), vote_split_cmp);
+
+    for(size_t k=0; k<n; k++) {
+      const vote_split_t *s = &splits[first + k];
+      
+      bv->thresholds[first + k] = s->threshold;
+      vote_bitvector_fill(left, bv->nb_words, k ? left - bv->nb_words : NULL);
+      vote_bitvector_clear(left, s->begin, s->middle);
+      left += bv->nb_words;
+      
+      s = &splits[first + n - 1 - k];
+      vote_bitvector_fill(right, bv->nb_words, k ? right - bv->nb_words : NULL);
+      vote_bitvector_clear(right, s->middle, s->end);
+      right += bv->nb_words;
+    }
+  }
+  
+  free(splits);
+  free(slot);
+  
+  return bv;
+}
+
+
+void
+vote_bitvector_del(vote_bitvector_t *bv) {
+  free(bv->thresholds);
+  free(bv->left);
+  free(bv->right);
+  free(bv->offset);
+  free(bv);
+}
+
+
+/**
+ * Count the number of sorted thresholds that are smaller than a value.
+ **/
+static inline size_t
+vote_bitvector_rank(const real_t *thresholds, size_t n, real_t value) {
+  size_t lo = 0;
+  size_t hi = n;
+
+  while(lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if(thresholds[mid] < value) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return lo;
+}
+
+
+/**
+ * Intersect a bitvector with another one.
+ **/
+static inline void
+vote_bitvector_and(uint64_t *restrict words, const uint64_t *restrict mask,
+		   size_t nb_words) {
+  for(size_t i=0; i<nb_words; i++) {
+    words[i] &= mask[i];
+  }
+}
+
+
+/**
+ * Compute the set of leaves of a tree that are reachable from an input region.
+ * The left child of a split is unreachable when the lower bound exceeds the
+ * threshold, and the right child when the upper bound does not.
+ **/
+static void
+vote_bitvector_reach(const vote_tree_t *t, const vote_bitvector_t *bv,
+		     const vote_bound_t *inputs, uint64_t *words) {
+  const size_t nb_words = bv->nb_words;
+  
+  memset(words, 0xff, nb_words * sizeof(uint64_t));
+  if(t->nb_leaves % VOTE_WORD_BITS) {
+    words[nb_words - 1] = ~UINT64_C(0) >> (VOTE_WORD_BITS -
+					   t->nb_leaves % VOTE_WORD_BITS);
+  }
+
+  for(size_t i=0; i<t->nb_features; i++) {
+    const vote_bound_t *b = &inputs[t->features[i]];
+    size_t first = bv->offset[i];
+    size_t n = bv->offset[i + 1] - first;
+    const real_t *thresholds = &bv->thresholds[first];
+    size_t nb_left = vote_bitvector_rank(thresholds, n, b->lower);
+    size_t nb_right = n - vote_bitvector_rank(thresholds, n, b->upper);
+
+    if(nb_left) {
+      vote_bitvector_and(words, &bv->left[(first + nb_left - 1) * nb_words],
+			 nb_words);
+    }
+    if(nb_right) {
+      vote_bitvector_and(words, &bv->right[(first + nb_right - 1) * nb_words],
+			 nb_words);
+    }
+  }
+}
+
+
+void
+vote_bitvector_join(const vote_tree_t *t, const vote_bitvector_t *bv,
+		    const vote_bound_t *inputs, vote_bound_t *outputs) {
+  uint64_t words[bv->nb_words + 1];
+
+  for(size_t i=0; i<t->nb_values; i++) {
+    outputs[i].lower = VOTE_INFINITY;
+    outputs[i].upper = -VOTE_INFINITY;
+  }
+
+  vote_bitvector_reach(t, bv, inputs, words);
+
+  for(size_t i=0; i<bv->nb_words; i++) {
+    for(uint64_t w=words[i]; w; w&=w-1) {
+      size_t leaf = i * VOTE_WORD_BITS + (size_t)__builtin_ctzll(w);
+      const real_t *value = &t->leaves[leaf * t->nb_values];
+      
+      for(size_t j=0; j<t->nb_values; j++) {
+	outputs[j].lower = vote_min(value[j], outputs[j].lower);
+	outputs[j].upper = vote_max(value[j], outputs[j].upper);
+      }
+    }
+  }
+}
+
+
+const real_t*
+vote_bitvector_eval(const vote_tree_t *t, const vote_bitvector_t *bv,
+		    const real_t *inputs) {
+  uint64_t words[bv->nb_words + 1];
+  vote_bound_t point[t->nb_inputs + 1];
+
+  for(size_t i=0; i<t->nb_inputs; i++) {
+    point[i].lower = inputs[i];
+    point[i].upper = inputs[i];
+  }
+  
+  vote_bitvector_reach(t, bv, point, words);
+
+  // exactly one leaf is reachable from a point, i.e. the first one left
+  for(size_t i=0; i<bv->nb_words; i++) {
+    if(words[i]) {
+      size_t leaf = i * VOTE_WORD_BITS + (size_t)__builtin_ctzll(words[i]);
+      return &t->leaves[leaf * t->nb_values];
+    }
+  }
+
+  assert(false);
+  return NULL;
+}
@@ -0,0 +1,64 @@
+/* Copyright (C) 2021 John Törnblom
+
+   This file is part of VoTE (Verifier of Tree Ensembles).
+
+VoTE is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+VoTE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or
+FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with VoTE; see the files COPYING and COPYING.LESSER. If not,
+see <http://www.gnu.org/licenses/>.  */
+
+#ifndef VOTE_BITVECTOR_H
+#define VOTE_BITVECTOR_H
+
+
+#include "vote.h"
+#include "vote_tree.h"
+
+
+/**
+ * A bitvector index of the leaves of a tree. For each feature, the index holds
+ * masks of the leaves that remain reachable when a region falls above the k
+ * smallest thresholds (or below the k largest ones) of that feature. The set
+ * of leaves reachable from a region is the intersection of at most two masks
+ * per feature, found without descending into the tree.
+ **/
+typedef struct vote_bitvector vote_bitvector_t;
+
+
+/**
+ * Create a bitvector index for a tree.
+ **/
+vote_bitvector_t* vote_bitvector_new(const vote_tree_t *t);
+
+
+/**
+ * Delete a bitvector index.
+ **/
+void vote_bitvector_del(vote_bitvector_t *bv);
+
+
+/**
+ * Compute the join of all leaves of a tree that are reachable from an input
+ * region, see vote_abstract_join_tree().
+ **/
+void vote_bitvector_join(const vote_tree_t *t, const vote_bitvector_t *bv,
+			 const vote_bound_t *inputs, vote_bound_t *outputs);
+
+
+/**
+ * Get the values of the leaf of a tree that is reached by concrete inputs.
+ **/
+const real_t* vote_bitvector_eval(const vote_tree_t *t, const vote_bitvector_t *bv,
+				  const real_t *inputs);
+
+
+#endif //VOTE_BITVECTOR_H
@@ -0,0 +1,235 @@
+/* Copyright (C) 2021 John Törnblom
+
+   This file is part of VoTE (Verifier of Tree Ensembles).
+
+VoTE is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+VoTE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or
+FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with VoTE; see the files COPYING and COPYING.LESSER. If not,
+see <http://www.gnu.org/licenses/>.  */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vote.h"
+#include "vote_budget.h"
+
+
+/**
+ * The number of nodes, mappings or polls charged between two reads of the
+ * clock. Workers also add their nodes to the shared count in batches of
+ * this size.
+ **/
+#define VOTE_BUDGET_CLOCK_INTERVAL 256
+
+
+/**
+ * The size of a cache line.
+ **/
+#define VOTE_BUDGET_ALIGNMENT 64
+
+
+/**
+ * The work a single worker charged since it last updated the shared counts,
+ * padded to a cache line of its own.
+ **/
+typedef union vote_budget_slot {
+  struct {
+    size_t nb_nodes;
+    size_t nb_polls;
+  } local;
+  char pad[VOTE_BUDGET_ALIGNMENT];
+} vote_budget_slot_t;
+
+
+struct vote_budget {
+  bool               active;
+  vote_limits_t      limits;
+  struct timespec    start;
+  size_t             nb_nodes;
+  size_t             nb_mappings;
+  bool               exhausted;
+
+  // one slot per worker
+  size_t              nb_workers;
+  vote_budget_slot_t *slots;
+};
+
+
+/**
+ * Mark the budget of the current run as exhausted.
+ **/
+static bool
+vote_budget_expire(vote_budget_t *b) {
+  __atomic_store_n(&b->exhausted, true, __ATOMIC_RELAXED);
+  return false;
+}
+
+
+/**
+ * Check the cancel flag of the current run, and optionally its deadline.
+ **/
+static bool
+vote_budget_check(vote_budget_t *b, bool clock) {
+  struct timespec now;
+  double elapsed;
+
+  if(__atomic_load_n(&b->exhausted, __ATOMIC_RELAXED)) {
+    return false;
+  }
+
+  if(b->limits.cancel && __atomic_load_n(b->limits.cancel, __ATOMIC_RELAXED)) {
+    return vote_budget_expire(b);
+  }
+
+  if(!clock || b->limits.max_seconds <= 0) {
+    return true;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  elapsed = (double)(now.tv_sec - b->start.tv_sec) +
+    (double)(now.tv_nsec - b->start.tv_nsec) * 1e-9;
+
+  if(elapsed >= b->limits.max_seconds) {
+    return vote_budget_expire(b);
+  }
+
+  return true;
+}
+
+
+/**
+ * Get the slot of the calling worker.
+ **/
+static vote_budget_slot_t*
+vote_budget_local(vote_budget_t *b, const vote_workpool_t *pool) {
+  size_t worker = pool ? vote_workpool_worker(pool) : 0;
+
+  assert(worker < b->nb_workers);
+
+  return &b->slots[worker];
+}
+
+
+vote_budget_t*
+vote_budget_new(size_t nb_workers) {
+  vote_budget_t *b = calloc(1, sizeof(vote_budget_t));
+  size_t size = nb_workers * sizeof(vote_budget_slot_t);
+
+  assert(b);
+
+  // slots are aligned to cache lines
+  if(posix_memalign((void**)&b->slots, VOTE_BUDGET_ALIGNMENT, size)) {
+    assert(false);
+  }
+  memset(b->slots, 0, size);
+
+  b->nb_workers = nb_workers;
+
+  return b;
+}
+
+
+void
+vote_budget_del(vote_budget_t *b) {
+  free(b->slots);
+  free(b);
+}
+
+
+void
+vote_budget_reset(vote_budget_t *b, const vote_limits_t *limits) {
+  vote_budget_slot_t *slots = b->slots;
+  size_t nb_workers = b->nb_workers;
+
+  memset(b, 0, sizeof(vote_budget_t));
+  memset(slots, 0, nb_workers * sizeof(vote_budget_slot_t));
+  b->slots = slots;
+  b->nb_workers = nb_workers;
+
+  if(limits) {
+    b->active = true;
+    b->limits = *limits;
+    clock_gettime(CLOCK_MONOTONIC, &b->start);
+  }
+}
+
+
+bool
+vote_budget_node(vote_budget_t *b, const vote_workpool_t *pool) {
+  vote_budget_slot_t *slot;
+  size_t n;
+
+  if(!b->active) {
+    return true;
+  }
+
+  slot = vote_budget_local(b, pool);
+  n = ++slot->local.nb_nodes;
+
+  // exact for a single worker, while other workers may hold up to a batch
+  // of nodes each that they have yet to add to the shared count
+  if(b->limits.max_nodes &&
+     __atomic_load_n(&b->nb_nodes, __ATOMIC_RELAXED) + n > b->limits.max_nodes) {
+    return vote_budget_expire(b);
+  }
+
+  if(n < VOTE_BUDGET_CLOCK_INTERVAL) {
+    return vote_budget_check(b, false);
+  }
+
+  slot->local.nb_nodes = 0;
+  __atomic_add_fetch(&b->nb_nodes, n, __ATOMIC_RELAXED);
+
+  return vote_budget_check(b, true);
+}
+
+
+bool
+vote_budget_mapping(vote_budget_t *b) {
+  size_t n;
+
+  if(!b->active) {
+    return true;
+  }
+
+  n = __atomic_add_fetch(&b->nb_mappings, 1, __ATOMIC_RELAXED);
+  if(b->limits.max_mappings && n > b->limits.max_mappings) {
+    return vote_budget_expire(b);
+  }
+
+  return vote_budget_check(b, !(n % VOTE_BUDGET_CLOCK_INTERVAL));
+}
+
+
+bool
+vote_budget_poll(vote_budget_t *b, const vote_workpool_t *pool) {
+  vote_budget_slot_t *slot;
+
+  if(!b->active) {
+    return true;
+  }
+
+  slot = vote_budget_local(b, pool);
+
+  return vote_budget_check(b, !(++slot->local.nb_polls %
+				VOTE_BUDGET_CLOCK_INTERVAL));
+}
+
+
+bool
+vote_budget_exhausted(const vote_budget_t *b) {
+  return __atomic_load_n(&b->exhausted, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,85 @@
+/* Copyright (C) 2021 John Törnblom
+
+   This file is part of VoTE (Verifier of Tree Ensembles).
+
+VoTE is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+VoTE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or
+FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with VoTE; see the files COPYING and COPYING.LESSER. If not,
+see <http://www.gnu.org/licenses/>.  */
+
+#ifndef VOTE_BUDGET_H
+#define VOTE_BUDGET_H
+
+
+#include "vote.h"
+#include "vote_workpool.h"
+
+
+/**
+ * The work carried out during a run of an analysis, measured against the
+ * limits of the run. Several threads may charge the same budget.
+ **/
+typedef struct vote_budget vote_budget_t;
+
+
+/**
+ * Create a new budget without any limits, charged by a given number of
+ * workers.
+ **/
+vote_budget_t* vote_budget_new(size_t nb_workers);
+
+
+/**
+ * Delete a budget.
+ **/
+void vote_budget_del(vote_budget_t *b);
+
+
+/**
+ * Start a new run with the given limits, or without any limits if NULL.
+ **/
+void vote_budget_reset(vote_budget_t *b, const vote_limits_t *limits);
+
+
+/**
+ * Charge the budget for a node visited while refining a tree by the calling
+ * worker of a pool, if any. Nodes are added to the shared count in batches.
+ *
+ * Returns false if the budget is exhausted.
+ **/
+bool vote_budget_node(vote_budget_t *b, const vote_workpool_t *pool);
+
+
+/**
+ * Charge the budget for a mapping passed to the callback of the run.
+ *
+ * Returns false if the budget is exhausted.
+ **/
+bool vote_budget_mapping(vote_budget_t *b);
+
+
+/**
+ * Check the cancel flag of the run without charging the budget for any work.
+ * The deadline is only checked every so many polls of the calling worker.
+ *
+ * Returns false if the budget is exhausted.
+ **/
+bool vote_budget_poll(vote_budget_t *b, const vote_workpool_t *pool);
+
+
+/**
+ * Check if the budget was exhausted during the current run.
+ **/
+bool vote_budget_exhausted(const vote_budget_t *b);
+
+
+#endif //VOTE_BUDGET_H
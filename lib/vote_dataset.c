@@ -454,7 +454,7 @@ vote_dataset_del(vote_dataset_t* ds) {
 
 
 real_t*
-vote_dataset_row(vote_dataset_t* ds, size_t index) {
+vote_dataset_row(const vote_dataset_t* ds, size_t index) {
   return &ds->data[index * ds->nb_cols];
 }
 
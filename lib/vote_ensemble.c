@@ -26,9 +26,10 @@ see <http://www.gnu.org/licenses/>.  */
 #include "vote_math.h"
 #include "vote_tree.h"
 #include "vote_pipeline.h"
-#include "vote_refinary.h"
 #include "vote_abstract.h"
 #include "vote_postproc.h"
+#include "vote_workpool.h"
+#include "vote_bitvector.h"
 
 
 static struct json_value_t*
@@ -168,91 +169,260 @@ vote_ensemble_del(vote_ensemble_t *e) {
 bool
 vote_ensemble_forall(const vote_ensemble_t *e, const vote_bound_t *inputs,
 		     vote_mapping_cb_t *user_cb, void *user_ctx) {
-  vote_pipeline_t *head = vote_postproc_pipeline(e, user_ctx, user_cb);
-    
-  for(size_t i=0; i<e->nb_trees; i++) {
-    vote_pipeline_t *sink = head;
-    head = vote_refinary_pipeline(e->trees[e->nb_trees-i-1]);
-    vote_pipeline_connect(head, sink);
-  }    
+  vote_plan_t *p = vote_plan_new(e, VOTE_STRATEGY_REFINE, 1);
+  bool res = vote_plan_run(p, inputs, user_cb, user_ctx);
 
-  vote_mapping_t *m = vote_mapping_new(e->nb_inputs, e->nb_outputs);
-  memcpy(m->inputs, inputs, e->nb_inputs * sizeof(vote_bound_t));
-  vote_outcome_t o = vote_pipeline_input(head, m);
+  vote_plan_del(p);
 
-  vote_mapping_del(m);
-  vote_pipeline_del(head);
-  
-  return o == VOTE_PASS;
+  return res;
+}
+
+
+bool
+vote_ensemble_forall_parallel(const vote_ensemble_t *e, const vote_bound_t *inputs,
+			      vote_mapping_cb_t *user_cb, void *user_ctx,
+			      size_t nb_threads) {
+  vote_plan_t *p = vote_plan_new(e, VOTE_STRATEGY_REFINE, nb_threads);
+  bool res = vote_plan_run(p, inputs, user_cb, user_ctx);
+
+  vote_plan_del(p);
+
+  return res;
 }
 
 
 bool
 vote_ensemble_absref(const vote_ensemble_t *e, const vote_bound_t *inputs,
 		     vote_mapping_cb_t *user_cb, void *user_ctx) {
-  vote_pipeline_t *pp = vote_postproc_pipeline(e, user_ctx, user_cb);
-  vote_pipeline_t *head = NULL;
-  vote_pipeline_t *tail = NULL;
-  
+  vote_plan_t *p = vote_plan_new(e, VOTE_STRATEGY_ABSREF, 1);
+  bool res = vote_plan_run(p, inputs, user_cb, user_ctx);
+
+  vote_plan_del(p);
+
+  return res;
+}
+
+
+bool
+vote_ensemble_absref_parallel(const vote_ensemble_t *e, const vote_bound_t *inputs,
+			      vote_mapping_cb_t *user_cb, void *user_ctx,
+			      size_t nb_threads, size_t *nb_tasks) {
+  vote_plan_t *p = vote_plan_new(e, VOTE_STRATEGY_ABSREF, nb_threads);
+  bool res = vote_plan_run(p, inputs, user_cb, user_ctx);
+
+  // the number of threads is only known to the plan when given as zero, and
+  // a plan whose threads could not be created runs on the calling thread
+  if(nb_tasks && nb_threads) {
+    memset(nb_tasks, 0, nb_threads * sizeof(size_t));
+    vote_plan_tasks(p, nb_tasks);
+  }
+
+  vote_plan_del(p);
+
+  return res;
+}
+
+
+vote_outcome_t
+vote_ensemble_forall_limited(const vote_ensemble_t *e, const vote_bound_t *inputs,
+			     vote_mapping_cb_t *user_cb, void *user_ctx,
+			     size_t nb_threads, const vote_limits_t *limits) {
+  vote_plan_t *p = vote_plan_new(e, VOTE_STRATEGY_REFINE, nb_threads);
+  vote_outcome_t res = vote_plan_run_limited(p, inputs, user_cb, user_ctx,
+					     limits);
+
+  vote_plan_del(p);
+
+  return res;
+}
+
+
+vote_outcome_t
+vote_ensemble_absref_limited(const vote_ensemble_t *e, const vote_bound_t *inputs,
+			     vote_mapping_cb_t *user_cb, void *user_ctx,
+			     size_t nb_threads, const vote_limits_t *limits) {
+  vote_plan_t *p = vote_plan_new(e, VOTE_STRATEGY_ABSREF, nb_threads);
+  vote_outcome_t res = vote_plan_run_limited(p, inputs, user_cb, user_ctx,
+					     limits);
+
+  vote_plan_del(p);
+
+  return res;
+}
+
+
+void
+vote_ensemble_set_backend(vote_ensemble_t *e, vote_backend_t backend) {
   for(size_t i=0; i<e->nb_trees; i++) {
-    vote_pipeline_t *abs = vote_abstract_pipeline(&e->trees[i], e->nb_trees - i, pp);
-    vote_pipeline_t *ref = vote_refinary_pipeline(e->trees[i]);
-    vote_pipeline_connect(abs, ref);
+    vote_tree_t *t = e->trees[i];
     
-    if(tail) {
-      vote_pipeline_connect(tail, abs);
-    }
-    if(!head) {
-      head = abs;
+    if(backend == VOTE_BACKEND_BITVECTOR && !t->bitvector) {
+      t->bitvector = vote_bitvector_new(t);
+    } else if(backend == VOTE_BACKEND_DESCENT && t->bitvector) {
+      vote_bitvector_del(t->bitvector);
+      t->bitvector = NULL;
     }
-    
-    tail = ref;
-  }    
+  }
+}
 
-  vote_pipeline_connect(tail, pp);
-  
-  vote_mapping_t *m = vote_mapping_new(e->nb_inputs, e->nb_outputs);
-  memcpy(m->inputs, inputs, e->nb_inputs * sizeof(vote_bound_t));
-  vote_outcome_t o = vote_pipeline_input(head, m);
 
-  vote_mapping_del(m);
-  vote_pipeline_del(head);
-  
-  return o == VOTE_PASS;
+void
+vote_ensemble_set_postproc_mode(vote_ensemble_t *e, vote_postproc_mode_t mode) {
+  e->postproc_mode = mode;
+}
+
+
+void
+vote_ensemble_set_domain(vote_ensemble_t *e, vote_domain_t domain) {
+  e->domain = domain;
+}
+
+
+void
+vote_ensemble_set_suffix_bounds(vote_ensemble_t *e, bool enabled) {
+  e->suffix_bounds = enabled;
+}
+
+
+void
+vote_ensemble_set_order(vote_ensemble_t *e, vote_order_t order) {
+  e->order = order;
+}
+
+
+void
+vote_ensemble_set_search(vote_ensemble_t *e, vote_search_t search) {
+  e->search = search;
 }
 
 
 /**
- * Copy the output from a precise mapping to a vector of scalars.
+ * The number of rows that are evaluated together in a batch, i.e. while the
+ * nodes of one tree remain in the cache.
  **/
-static vote_outcome_t
-vote_ensemble_copy_scalar_outputs(void *ctx, vote_mapping_t *m) {
-  real_t *outputs = ctx;
+#define VOTE_EVAL_BLOCK_SIZE 64
 
-  assert(vote_mapping_precise(m));
-  
-  for(size_t i=0; i<m->nb_outputs; i++) {
-    outputs[i] = m->outputs[i].lower;
+
+/**
+ * Get the values of the leaf of a tree that is reached by concrete inputs.
+ **/
+static inline const real_t*
+vote_ensemble_eval_tree(const vote_tree_t *t, const real_t *inputs) {
+  if(t->bitvector) {
+    return vote_bitvector_eval(t, t->bitvector, inputs);
   }
 
-  return VOTE_PASS;
+  return vote_tree_eval(t, inputs);
+}
+
+
+/**
+ * Evaluate an ensemble on a block of rows, one tree at a time, without going
+ * through a pipeline. Inputs that are NaN reach no leaves, which yields NaN
+ * outputs just like an analysis of a degenerate region would.
+ **/
+static void
+vote_ensemble_eval_block(const vote_ensemble_t *e, const real_t *rows,
+			 size_t nb_rows, real_t *outputs) {
+  vote_bound_t bounds[e->nb_outputs];
+
+  memset(outputs, 0, nb_rows * e->nb_outputs * sizeof(real_t));
+
+  for(size_t i=0; i<e->nb_trees; i++) {
+    const vote_tree_t *t = e->trees[i];
+
+    for(size_t r=0; r<nb_rows; r++) {
+      const real_t *value = vote_ensemble_eval_tree(t, &rows[r * e->nb_inputs]);
+      real_t *sum = &outputs[r * e->nb_outputs + t->output];
+
+      for(size_t j=0; j<t->nb_values; j++) {
+	sum[j] += value[j];
+      }
+    }
+  }
+
+  for(size_t r=0; r<nb_rows; r++) {
+    const real_t *inputs = &rows[r * e->nb_inputs];
+    real_t *sum = &outputs[r * e->nb_outputs];
+    bool nan = false;
+
+    for(size_t i=0; i<e->nb_inputs; i++) {
+      nan |= isnan(inputs[i]);
+    }
+
+    for(size_t j=0; j<e->nb_outputs; j++) {
+      bounds[j].lower = sum[j];
+      bounds[j].upper = sum[j];
+    }
+
+    vote_ensemble_postproc(e, bounds);
+
+    for(size_t j=0; j<e->nb_outputs; j++) {
+      sum[j] = nan ? VOTE_NAN : bounds[j].lower;
+    }
+  }
 }
 
 
 void
 vote_ensemble_eval(const vote_ensemble_t *e, const real_t *inputs, real_t *outputs) {
-  vote_bound_t input_region[e->nb_inputs];
+  vote_ensemble_eval_block(e, inputs, 1, outputs);
+}
 
-  for(size_t i=0; i<e->nb_inputs; i++) {
-    input_region[i].lower = inputs[i];
-    input_region[i].upper = inputs[i];
+
+void
+vote_ensemble_eval_batch(const vote_ensemble_t *e, const real_t *rows,
+			 size_t nb_rows, real_t *outputs) {
+  for(size_t r=0; r<nb_rows; r+=VOTE_EVAL_BLOCK_SIZE) {
+    size_t n = nb_rows - r < VOTE_EVAL_BLOCK_SIZE ? nb_rows - r : VOTE_EVAL_BLOCK_SIZE;
+    vote_ensemble_eval_block(e, &rows[r * e->nb_inputs], n,
+			     &outputs[r * e->nb_outputs]);
   }
-  
-  for(size_t i=0; i<e->nb_outputs; i++) {
-    outputs[i] = VOTE_NAN;
+}
+
+
+/**
+ * Arguments passed along to workers that evaluate a batch of rows.
+ **/
+typedef struct vote_ensemble_batch {
+  const vote_ensemble_t *ensemble;
+  const real_t          *rows;
+  real_t                *outputs;
+} vote_ensemble_batch_t;
+
+
+/**
+ * Evaluate the rows [begin, end) of a batch.
+ **/
+static void
+vote_ensemble_batch_range(const void *ctx, size_t begin, size_t end) {
+  const vote_ensemble_batch_t *b = ctx;
+  const vote_ensemble_t *e = b->ensemble;
+
+  vote_ensemble_eval_batch(e, &b->rows[begin * e->nb_inputs], end - begin,
+			   &b->outputs[begin * e->nb_outputs]);
+}
+
+
+void
+vote_ensemble_eval_batch_parallel(const vote_ensemble_t *e, const real_t *rows,
+				  size_t nb_rows, real_t *outputs,
+				  size_t nb_threads) {
+  vote_workpool_t *pool = vote_workpool_new(nb_threads);
+  vote_ensemble_batch_t b = {
+    .ensemble = e,
+    .rows = rows,
+    .outputs = outputs
+  };
+
+  if(!pool) {
+    vote_ensemble_eval_batch(e, rows, nb_rows, outputs);
+    return;
   }
-  
-  vote_ensemble_forall(e, input_region, vote_ensemble_copy_scalar_outputs, outputs);
+
+  vote_workpool_range(pool, vote_ensemble_batch_range, &b, nb_rows,
+		      VOTE_EVAL_BLOCK_SIZE);
+  vote_workpool_del(pool);
 }
 
 
@@ -265,6 +435,7 @@ vote_ensemble_copy_mapping_outputs(void *ctx, vote_mapping_t *source) {
 
   memcpy(target->outputs, source->outputs,
 	 source->nb_outputs * sizeof(vote_bound_t));
+  target->post_process = source->post_process;
   
   return VOTE_PASS;
 }
@@ -274,7 +445,9 @@ vote_mapping_t *
 vote_ensemble_approximate(const vote_ensemble_t *e, const vote_bound_t *inputs) {
   vote_mapping_t *m = vote_mapping_new(e->nb_inputs, e->nb_outputs);
   vote_pipeline_t *pp = vote_postproc_pipeline(e, m, vote_ensemble_copy_mapping_outputs);
-  vote_pipeline_t *a = vote_abstract_pipeline(e->trees, e->nb_trees, pp);
+  vote_pipeline_t *a = vote_abstract_pipeline(e->trees, e->nb_trees, NULL,
+					      VOTE_DOMAIN_INTERVAL, NULL,
+					      pp, NULL, NULL, NULL, NULL);
 
   vote_pipeline_connect(a, pp);
   memcpy(m->inputs, inputs, e->nb_inputs * sizeof(vote_bound_t));
@@ -0,0 +1,268 @@
+/* Copyright (C) 2021 John Törnblom
+
+   This file is part of VoTE (Verifier of Tree Ensembles).
+
+VoTE is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+VoTE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or
+FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with VoTE; see the files COPYING and COPYING.LESSER. If not,
+see <http://www.gnu.org/licenses/>.  */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vote.h"
+#include "vote_math.h"
+#include "vote_tree.h"
+#include "vote_postproc.h"
+#include "vote_order.h"
+
+
+/**
+ * An internal node on the current path, together with the bounds of the
+ * input it tests as they were before the split, and the child that remains
+ * to be visited, if any. Trees are referred to by their position in the
+ * order of refinement.
+ **/
+typedef struct vote_iter_frame {
+  size_t tree;
+  size_t node;
+  size_t second;
+  real_t lower;
+  real_t upper;
+} vote_iter_frame_t;
+
+
+struct vote_iter {
+  const vote_ensemble_t *ensemble;
+  vote_tree_t          **trees;
+  vote_mapping_t        *mapping;
+  real_t                *sums;
+  real_t                *trail;
+  vote_iter_frame_t     *stack;
+  size_t                 depth;
+  size_t                 capacity;
+  size_t                 tree;
+  size_t                 node;
+  bool                   descend;
+};
+
+
+/**
+ * Marks a frame without any child left to visit.
+ **/
+#define VOTE_ITER_NONE SIZE_MAX
+
+
+/**
+ * Narrow an input region to one of the children of a node.
+ **/
+static void
+vote_iter_split(vote_bound_t *input, const vote_node_t *n, size_t child) {
+  if(child == (size_t)n->child) {
+    if(input->upper > n->threshold) {
+      input->upper = n->threshold;
+    }
+  } else if(input->lower < n->threshold) {
+    input->lower = vote_nextafter(n->threshold, VOTE_INFINITY);
+  }
+}
+
+
+/**
+ * Push an internal node onto the path, and narrow the input region to the
+ * child that is visited first, i.e. the one with the least input space.
+ *
+ * Returns false if neither child is feasible.
+ **/
+static inline bool
+vote_iter_push(vote_iter_t *it, const vote_node_t *n) {
+  vote_bound_t *input = &it->mapping->inputs[n->feature];
+  size_t left_id = (size_t)n->child;
+  size_t right_id = left_id + 1;
+  bool left = input->lower <= n->threshold;
+  bool right = input->upper > n->threshold;
+  vote_iter_frame_t *f;
+
+  if(!left && !right) {
+    return false;
+  }
+
+  if(it->depth == it->capacity) {
+    it->capacity = it->capacity ? it->capacity * 2 : 64;
+    it->stack = realloc(it->stack, it->capacity * sizeof(vote_iter_frame_t));
+    assert(it->stack);
+  }
+
+  f = &it->stack[it->depth++];
+  f->tree = it->tree;
+  f->node = it->node;
+  f->lower = input->lower;
+  f->upper = input->upper;
+
+  if(left && right) {
+    if(n->threshold - input->lower < input->upper - n->threshold) {
+      it->node = left_id;
+      f->second = right_id;
+    } else {
+      it->node = right_id;
+      f->second = left_id;
+    }
+  } else {
+    it->node = left ? left_id : right_id;
+    f->second = VOTE_ITER_NONE;
+  }
+
+  vote_iter_split(input, n, it->node);
+
+  return true;
+}
+
+
+vote_iter_t*
+vote_iter_new(const vote_ensemble_t *e, const vote_bound_t *inputs) {
+  vote_iter_t *it = calloc(1, sizeof(vote_iter_t));
+  assert(it);
+
+  it->ensemble = e;
+  it->trees = calloc(e->nb_trees + 1, sizeof(vote_tree_t*));
+  assert(it->trees);
+  
+  memcpy(it->trees, e->trees, e->nb_trees * sizeof(vote_tree_t*));
+  
+  it->mapping = vote_mapping_new(e->nb_inputs, e->nb_outputs);
+  it->sums = calloc(e->nb_outputs + 1, sizeof(real_t));
+  assert(it->sums);
+
+  it->trail = calloc(e->nb_trees * e->nb_outputs + 1, sizeof(real_t));
+  assert(it->trail);
+
+  vote_iter_reset(it, inputs);
+
+  return it;
+}
+
+
+void
+vote_iter_reset(vote_iter_t *it, const vote_bound_t *inputs) {
+  vote_mapping_t *m = it->mapping;
+
+  memcpy(m->inputs, inputs, m->nb_inputs * sizeof(vote_bound_t));
+  memset(it->sums, 0, m->nb_outputs * sizeof(real_t));
+
+  it->depth = 0;
+  it->tree = 0;
+  it->node = 0;
+  it->descend = true;
+}
+
+
+vote_mapping_t*
+vote_iter_next(vote_iter_t *it) {
+  const vote_ensemble_t *e = it->ensemble;
+  vote_mapping_t *m = it->mapping;
+
+  for(;;) {
+    // all trees have been refined, emit mapping
+    if(it->descend && it->tree == e->nb_trees) {
+      for(size_t i=0; i<e->nb_outputs; i++) {
+	m->outputs[i].lower = it->sums[i];
+	m->outputs[i].upper = it->sums[i];
+      }
+      vote_postproc_mapping(e, m);
+
+      it->descend = false;
+      return m;
+    }
+
+    // entering the next tree, pick the one to refine among those remaining.
+    // Trees that have been refined keep their positions while backtracking.
+    if(it->descend && !it->node && e->order != VOTE_ORDER_FILE) {
+      size_t i = it->tree + vote_order_pick(&it->trees[it->tree],
+					    e->nb_trees - it->tree,
+					    e->order, m->inputs);
+      vote_tree_t *t = it->trees[i];
+      
+      it->trees[i] = it->trees[it->tree];
+      it->trees[it->tree] = t;
+    }
+    
+    if(it->descend) {
+      const vote_tree_t *t = it->trees[it->tree];
+      const vote_node_t *n = &t->nodes[it->node];
+
+      while(!vote_node_is_leaf(n) && (it->descend = vote_iter_push(it, n))) {
+	n = &t->nodes[it->node];
+      }
+
+      if(!it->descend) {
+	continue;
+      }
+
+      // leaf node encountered, log the sums it changes and continue with
+      // the next tree
+      const real_t *value = vote_node_value(t, n);
+      real_t *sum = &it->sums[t->output];
+      real_t *trail = &it->trail[it->tree * e->nb_outputs];
+
+      for(size_t i=0; i<t->nb_values; i++) {
+	trail[i] = sum[i];
+	sum[i] += value[i];
+      }
+
+      it->tree++;
+      it->node = 0;
+      continue;
+    }
+
+    // backtrack to the most recent node with a child left to visit
+    if(!it->depth) {
+      return NULL;
+    }
+
+    vote_iter_frame_t *f = &it->stack[it->depth - 1];
+    const vote_node_t *n = &it->trees[f->tree]->nodes[f->node];
+    vote_bound_t *input = &m->inputs[n->feature];
+
+    // undo the leaves of the trees that succeed the frame
+    while(it->tree > f->tree) {
+      const vote_tree_t *t = it->trees[--it->tree];
+      
+      memcpy(&it->sums[t->output], &it->trail[it->tree * e->nb_outputs],
+	     t->nb_values * sizeof(real_t));
+    }
+
+    input->lower = f->lower;
+    input->upper = f->upper;
+
+    if(f->second == VOTE_ITER_NONE) {
+      it->depth--;
+      continue;
+    }
+
+    vote_iter_split(input, n, f->second);
+    it->node = f->second;
+    it->descend = true;
+    f->second = VOTE_ITER_NONE;
+  }
+}
+
+
+void
+vote_iter_del(vote_iter_t *it) {
+  vote_mapping_del(it->mapping);
+  free(it->trees);
+  free(it->sums);
+  free(it->trail);
+  free(it->stack);
+  free(it);
+}
@@ -59,6 +59,7 @@ vote_mapping_copy(const vote_mapping_t* m) {
   
   c->nb_inputs = m->nb_inputs;
   c->nb_outputs = m->nb_outputs;
+  c->post_process = m->post_process;
 
   c->inputs = malloc(c->nb_inputs * sizeof(vote_bound_t));
   assert(c->inputs);
@@ -69,6 +70,17 @@ vote_mapping_copy(const vote_mapping_t* m) {
   memcpy(c->inputs, m->inputs, m->nb_inputs * sizeof(vote_bound_t));
   memcpy(c->outputs, m->outputs, m->nb_outputs * sizeof(vote_bound_t));
 
+  c->differences = NULL;
+  c->reference = m->reference;
+  if(m->differences) {
+    size_t size = m->nb_outputs * sizeof(vote_bound_t);
+    
+    c->differences = malloc(size);
+    assert(c->differences);
+    
+    memcpy(c->differences, m->differences, size);
+  }
+
   return c;
 }
 
@@ -77,18 +89,63 @@ void
 vote_mapping_del(vote_mapping_t* m) {
   free(m->inputs);
   free(m->outputs);
+  free(m->differences);
   free(m);
 }
 
 
+/**
+ * The decision boundary of the output in 0/1 classification, i.e. a
+ * probability, or a logit if the sigmoid has yet to be applied.
+ **/
+static real_t
+vote_mapping_threshold(const vote_mapping_t* m) {
+  if(m->post_process == VOTE_POST_PROCESS_SIGMOID) {
+    return 0;
+  }
+  
+  return (real_t)0.5;
+}
+
+
+/**
+ * Get the bound of the difference outputs[i] - outputs[j] of a mapping before
+ * post processing, if the mapping bounds it. Post processing preserves the
+ * order of outputs, so the sign of the difference orders the post processed
+ * outputs as well.
+ **/
+static bool
+vote_mapping_difference(const vote_mapping_t* m, size_t i, size_t j,
+			vote_bound_t *diff) {
+  if(!m->differences) {
+    return false;
+  }
+  
+  if(i == m->reference) {
+    *diff = m->differences[j];
+    return true;
+  }
+
+  if(j == m->reference) {
+    diff->lower = -m->differences[i].upper;
+    diff->upper = -m->differences[i].lower;
+    return true;
+  }
+
+  return false;
+}
+
+
 int
 vote_mapping_argmax(const vote_mapping_t* m) {
   size_t k = 0;
 
-  // assume the output is probability in 0/1 classification
+  // assume the output is a probability (or logit) in 0/1 classification
   if(m->nb_outputs == 1) {
-    if((m->outputs[0].lower >= (real_t)0.5) == (m->outputs[0].upper >= (real_t)0.5)) {
-      return m->outputs[0].lower >= (real_t)0.5;
+    real_t threshold = vote_mapping_threshold(m);
+
+    if((m->outputs[0].lower >= threshold) == (m->outputs[0].upper >= threshold)) {
+      return m->outputs[0].lower >= threshold;
     }
     return -1;
   }
@@ -117,12 +174,14 @@ vote_outcome_t
 vote_mapping_check_argmax(const vote_mapping_t* m, size_t expected) {
   size_t k = 1;
 
-  // assume the output is probability in 0/1 classification
+  // assume the output is a probability (or logit) in 0/1 classification
   if(m->nb_outputs == 1) {
-    if((m->outputs[0].lower >= (real_t)0.5) != (m->outputs[0].upper >= (real_t)0.5)) {
+    real_t threshold = vote_mapping_threshold(m);
+
+    if((m->outputs[0].lower >= threshold) != (m->outputs[0].upper >= threshold)) {
       return VOTE_UNSURE;
     }
-    if((m->outputs[0].lower >= (real_t)0.5) == expected) {
+    if((m->outputs[0].lower >= threshold) == expected) {
       return VOTE_PASS;
     }
     return VOTE_FAIL;
@@ -131,12 +190,16 @@ vote_mapping_check_argmax(const vote_mapping_t* m, size_t expected) {
   assert(m->nb_outputs > expected);
   
   for(size_t i=0; i<m->nb_outputs; i++) {
-    if(m->outputs[expected].upper < m->outputs[i].lower) {
+    vote_bound_t diff;
+    bool related = vote_mapping_difference(m, expected, i, &diff);
+    
+    if(m->outputs[expected].upper < m->outputs[i].lower ||
+       (related && diff.upper < 0)) {
       return VOTE_FAIL;
     }
 
-    k += (m->outputs[expected].lower >= m->outputs[i].upper &&
-	  expected != i);
+    k += ((m->outputs[expected].lower >= m->outputs[i].upper ||
+	   (related && diff.lower >= 0)) && expected != i);
   }
 
   if(k == m->nb_outputs) {
@@ -151,10 +214,12 @@ int
 vote_mapping_argmin(const vote_mapping_t* m) {
   size_t k = 0;
 
-  // assume the output is probability in 0/1 classification
+  // assume the output is a probability (or logit) in 0/1 classification
   if(m->nb_outputs == 1) {
-    if((m->outputs[0].lower <= (real_t)0.5) == (m->outputs[0].upper <= (real_t)0.5)) {
-      return m->outputs[0].lower <= (real_t)0.5;
+    real_t threshold = vote_mapping_threshold(m);
+
+    if((m->outputs[0].lower <= threshold) == (m->outputs[0].upper <= threshold)) {
+      return m->outputs[0].lower <= threshold;
     }
     return -1;
   }
@@ -183,12 +248,14 @@ vote_outcome_t
 vote_mapping_check_argmin(const vote_mapping_t* m, size_t expected) {
   size_t k = 1;
 
-  // assume the output is probability in 0/1 classification
+  // assume the output is a probability (or logit) in 0/1 classification
   if(m->nb_outputs == 1) {
-    if((m->outputs[0].lower <= (real_t)0.5) != (m->outputs[0].upper <= (real_t)0.5)) {
+    real_t threshold = vote_mapping_threshold(m);
+
+    if((m->outputs[0].lower <= threshold) != (m->outputs[0].upper <= threshold)) {
       return VOTE_UNSURE;
     }
-    if((m->outputs[0].lower <= (real_t)0.5) == expected) {
+    if((m->outputs[0].lower <= threshold) == expected) {
       return VOTE_PASS;
     }
     return VOTE_FAIL;
@@ -197,12 +264,16 @@ vote_mapping_check_argmin(const vote_mapping_t* m, size_t expected) {
   assert(m->nb_outputs > expected);
   
   for(size_t i=0; i<m->nb_outputs; i++) {
-    if(m->outputs[expected].lower > m->outputs[i].upper) {
+    vote_bound_t diff;
+    bool related = vote_mapping_difference(m, expected, i, &diff);
+    
+    if(m->outputs[expected].lower > m->outputs[i].upper ||
+       (related && diff.lower > 0)) {
       return VOTE_FAIL;
     }
 
-    k += (m->outputs[expected].upper <= m->outputs[i].lower &&
-	  expected != i);
+    k += ((m->outputs[expected].upper <= m->outputs[i].lower ||
+	   (related && diff.upper <= 0)) && expected != i);
   }
 
   if(k == m->nb_outputs) {
@@ -0,0 +1,626 @@
+/* Copyright (C) 2021 John Törnblom
+
+   This file is part of VoTE (Verifier of Tree Ensembles).
+
+VoTE is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+VoTE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or
+FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with VoTE; see the files COPYING and COPYING.LESSER. If not,
+see <http://www.gnu.org/licenses/>.  */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vote.h"
+#include "vote_math.h"
+#include "vote_tree.h"
+#include "vote_abstract.h"
+#include "vote_postproc.h"
+#include "vote_order.h"
+
+
+/**
+ * The largest number of regions that a search keeps open. Once reached,
+ * searches for an optimum refine new regions depth-first instead, while
+ * anytime approximations stop refining.
+ **/
+#define VOTE_OPTIMIZE_MAX_OPEN 65536
+
+
+/**
+ * The goal of a search, i.e. maximize or minimize a single output, or tighten
+ * the bounds of all outputs, where the widest regions are refined first.
+ **/
+typedef enum vote_optimize_goal {
+  VOTE_OPTIMIZE_MAXIMIZE,
+  VOTE_OPTIMIZE_MINIMIZE,
+  VOTE_OPTIMIZE_TIGHTEN
+} vote_optimize_goal_t;
+
+
+/**
+ * An open region of the search, i.e. the inputs of a mapping narrowed to one
+ * leaf in each of the first depth trees, with the exact sum of those leaves as
+ * its outputs, together with the priority of the region.
+ **/
+typedef struct vote_optimize_node {
+  real_t          bound;
+  size_t          depth;
+  vote_mapping_t *mapping;
+} vote_optimize_node_t;
+
+
+/**
+ * The state of a branch-and-bound search. When optimizing a single output,
+ * the search maximizes its objective, i.e. the output negated when
+ * minimizing. When tightening bounds, the hull joins the outputs of all
+ * regions that have been settled.
+ **/
+typedef struct vote_optimize {
+  const vote_ensemble_t *ensemble;
+  vote_tree_t          **trees;
+  size_t                 output;
+  vote_optimize_goal_t   goal;
+  vote_optimize_node_t  *open;
+  size_t                 nb_open;
+  size_t                 capacity;
+  size_t                 nb_expanded;
+  bool                   found;
+  real_t                 incumbent;
+  vote_bound_t          *witness;
+  vote_bound_t          *hull;
+  vote_bound_t          *outputs;
+  real_t                *point;
+  real_t                *values;
+} vote_optimize_t;
+
+
+static void vote_optimize_refine(vote_optimize_t *o,
+				 const vote_optimize_node_t *node);
+
+
+/**
+ * Get the priority of the post-processed output bounds of a region, i.e. the
+ * bound on the objective when optimizing, and the total width of the output
+ * bounds when tightening.
+ **/
+static real_t
+vote_optimize_priority(const vote_optimize_t *o) {
+  const vote_bound_t *b = o->outputs;
+  real_t width = 0;
+
+  switch(o->goal) {
+  case VOTE_OPTIMIZE_MAXIMIZE:
+    return b[o->output].upper;
+
+  case VOTE_OPTIMIZE_MINIMIZE:
+    return -b[o->output].lower;
+
+  default:
+  case VOTE_OPTIMIZE_TIGHTEN:
+    for(size_t i=0; i<o->ensemble->nb_outputs; i++) {
+      width += b[i].upper - b[i].lower;
+    }
+    return width;
+  }
+}
+
+
+/**
+ * Bound the post-processed outputs in a region, given the exact sums of the
+ * trees that have been refined, by joining the remaining trees.
+ *
+ * Returns the priority of the region.
+ **/
+static real_t
+vote_optimize_bound(vote_optimize_t *o, const vote_mapping_t *m, size_t depth) {
+  const vote_ensemble_t *e = o->ensemble;
+  vote_bound_t tree_outputs[e->nb_outputs + 1];
+
+  memcpy(o->outputs, m->outputs, e->nb_outputs * sizeof(vote_bound_t));
+
+  for(size_t i=depth; i<e->nb_trees; i++) {
+    const vote_tree_t *t = o->trees[i];
+
+    vote_abstract_join_tree(t, m->inputs, e->nb_inputs, tree_outputs);
+    for(size_t dim=0; dim<t->nb_values; dim++) {
+      o->outputs[t->output + dim].lower += tree_outputs[dim].lower;
+      o->outputs[t->output + dim].upper += tree_outputs[dim].upper;
+    }
+  }
+
+  vote_ensemble_postproc(e, o->outputs);
+
+  return vote_optimize_priority(o);
+}
+
+
+/**
+ * Push an open region onto the priority queue.
+ **/
+static void
+vote_optimize_push(vote_optimize_t *o, real_t bound, size_t depth,
+		   vote_mapping_t *m) {
+  size_t i = o->nb_open++;
+
+  if(o->nb_open > o->capacity) {
+    o->capacity = o->capacity ? o->capacity * 2 : 64;
+    o->open = realloc(o->open, o->capacity * sizeof(vote_optimize_node_t));
+    assert(o->open);
+  }
+
+  while(i && o->open[(i - 1) / 2].bound < bound) {
+    o->open[i] = o->open[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+
+  o->open[i].bound = bound;
+  o->open[i].depth = depth;
+  o->open[i].mapping = m;
+}
+
+
+/**
+ * Pop the open region with the largest priority from the priority queue.
+ **/
+static vote_optimize_node_t
+vote_optimize_pop(vote_optimize_t *o) {
+  vote_optimize_node_t top = o->open[0];
+  vote_optimize_node_t last = o->open[--o->nb_open];
+  size_t i = 0;
+
+  for(;;) {
+    size_t child = 2 * i + 1;
+
+    if(child >= o->nb_open) {
+      break;
+    }
+    if(child + 1 < o->nb_open &&
+       o->open[child + 1].bound > o->open[child].bound) {
+      child++;
+    }
+    if(o->open[child].bound <= last.bound) {
+      break;
+    }
+
+    o->open[i] = o->open[child];
+    i = child;
+  }
+
+  if(o->nb_open) {
+    o->open[i] = last;
+  }
+
+  return top;
+}
+
+
+/**
+ * Record a new incumbent, i.e. the best objective attained so far, together
+ * with a region in which it is attained.
+ **/
+static void
+vote_optimize_improve(vote_optimize_t *o, real_t value,
+		      const vote_bound_t *region) {
+  if(o->found && value <= o->incumbent) {
+    return;
+  }
+
+  o->found = true;
+  o->incumbent = value;
+  memcpy(o->witness, region, o->ensemble->nb_inputs * sizeof(vote_bound_t));
+}
+
+
+/**
+ * Join the current output bounds into the hull.
+ **/
+static void
+vote_optimize_join(vote_optimize_t *o) {
+  for(size_t i=0; i<o->ensemble->nb_outputs; i++) {
+    if(!o->found || o->outputs[i].lower < o->hull[i].lower) {
+      o->hull[i].lower = o->outputs[i].lower;
+    }
+    if(!o->found || o->outputs[i].upper > o->hull[i].upper) {
+      o->hull[i].upper = o->outputs[i].upper;
+    }
+  }
+
+  o->found = true;
+}
+
+
+/**
+ * Settle a region whose output bounds are precise, i.e. record its objective
+ * or join its outputs into the hull.
+ **/
+static void
+vote_optimize_settle(vote_optimize_t *o, real_t bound,
+		     const vote_bound_t *region) {
+  if(o->goal == VOTE_OPTIMIZE_TIGHTEN) {
+    vote_optimize_join(o);
+  } else {
+    vote_optimize_improve(o, bound, region);
+  }
+}
+
+
+/**
+ * Check if a region cannot contribute to the result of a search, i.e. if its
+ * bound on the objective is no better than the incumbent, or if its output
+ * bounds lie within the hull.
+ **/
+static bool
+vote_optimize_prunable(const vote_optimize_t *o, real_t bound) {
+  if(!o->found) {
+    return false;
+  }
+
+  if(o->goal != VOTE_OPTIMIZE_TIGHTEN) {
+    return bound <= o->incumbent;
+  }
+
+  for(size_t i=0; i<o->ensemble->nb_outputs; i++) {
+    if(o->outputs[i].lower < o->hull[i].lower ||
+       o->outputs[i].upper > o->hull[i].upper) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+/**
+ * Evaluate the ensemble at a representative point of a region, so that the
+ * search has an incumbent to prune with long before it reaches a region
+ * where all trees have been refined.
+ **/
+static void
+vote_optimize_probe(vote_optimize_t *o, const vote_mapping_t *m) {
+  const vote_ensemble_t *e = o->ensemble;
+  vote_bound_t region[e->nb_inputs + 1];
+  real_t value;
+
+  for(size_t i=0; i<e->nb_inputs; i++) {
+    const vote_bound_t *b = &m->inputs[i];
+
+    if(b->lower > -VOTE_INFINITY && b->upper < VOTE_INFINITY) {
+      o->point[i] = b->lower + (b->upper - b->lower) / 2;
+    } else if(b->lower > -VOTE_INFINITY) {
+      o->point[i] = b->lower;
+    } else if(b->upper < VOTE_INFINITY) {
+      o->point[i] = b->upper;
+    } else {
+      o->point[i] = 0;
+    }
+
+    region[i].lower = o->point[i];
+    region[i].upper = o->point[i];
+  }
+
+  vote_ensemble_eval(e, o->point, o->values);
+  value = o->values[o->output];
+  vote_optimize_improve(o, o->goal == VOTE_OPTIMIZE_MINIMIZE ? -value : value,
+			region);
+}
+
+
+/**
+ * Enumerate the leaves of a tree that are reachable from a region, narrowing
+ * its inputs along the way, and enqueue the resulting regions unless they
+ * are pruned. Regions with precise output bounds are settled right away, and
+ * regions that do not fit in a full queue are refined right away.
+ **/
+static void
+vote_optimize_branch(vote_optimize_t *o, const vote_optimize_node_t *parent,
+		     const vote_tree_t *t, size_t node_id) {
+  const vote_node_t *n = &t->nodes[node_id];
+  vote_mapping_t *m = parent->mapping;
+
+  if(vote_node_is_leaf(n)) {
+    const real_t *value = vote_node_value(t, n);
+    vote_mapping_t *child = vote_mapping_copy(m);
+    size_t depth = parent->depth + 1;
+    real_t bound;
+
+    for(size_t i=0; i<t->nb_values; i++) {
+      child->outputs[t->output + i].lower += value[i];
+      child->outputs[t->output + i].upper += value[i];
+    }
+
+    bound = vote_optimize_bound(o, child, depth);
+    if(depth == o->ensemble->nb_trees ||
+       (o->goal == VOTE_OPTIMIZE_TIGHTEN && bound <= 0)) {
+      vote_optimize_settle(o, bound, child->inputs);
+    } else if(!vote_optimize_prunable(o, bound)) {
+      vote_optimize_node_t node = {
+	.bound = bound,
+	.depth = depth,
+	.mapping = child
+      };
+
+      if(o->nb_open < VOTE_OPTIMIZE_MAX_OPEN) {
+	vote_optimize_push(o, bound, depth, child);
+	return;
+      }
+
+      // the queue is full, join the region unrefined when tightening, or
+      // continue depth-first when optimizing
+      if(o->goal == VOTE_OPTIMIZE_TIGHTEN) {
+	vote_optimize_join(o);
+      } else {
+	vote_optimize_refine(o, &node);
+      }
+    }
+
+    vote_mapping_del(child);
+    return;
+  }
+
+  vote_bound_t *input = &m->inputs[n->feature];
+  real_t lower = input->lower;
+  real_t upper = input->upper;
+
+  if(lower <= n->threshold) {
+    input->upper = vote_min(upper, n->threshold);
+    vote_optimize_branch(o, parent, t, (size_t)n->child);
+    input->upper = upper;
+  }
+
+  if(upper > n->threshold) {
+    if(lower < n->threshold) {
+      input->lower = vote_nextafter(n->threshold, VOTE_INFINITY);
+    }
+    vote_optimize_branch(o, parent, t, (size_t)n->child + 1);
+    input->lower = lower;
+  }
+}
+
+
+/**
+ * Either settle a region, or refine the next tree in it.
+ **/
+static void
+vote_optimize_refine(vote_optimize_t *o, const vote_optimize_node_t *node) {
+  const vote_ensemble_t *e = o->ensemble;
+
+  if(node->depth == e->nb_trees) {
+    vote_optimize_settle(o, vote_optimize_bound(o, node->mapping, node->depth),
+			 node->mapping->inputs);
+  } else {
+    if(o->goal != VOTE_OPTIMIZE_TIGHTEN) {
+      vote_optimize_probe(o, node->mapping);
+    }
+    vote_optimize_branch(o, node, o->trees[node->depth], 0);
+  }
+
+  o->nb_expanded++;
+}
+
+
+/**
+ * Pop the open region with the largest priority, and refine it.
+ **/
+static void
+vote_optimize_expand(vote_optimize_t *o) {
+  vote_optimize_node_t node = vote_optimize_pop(o);
+
+  vote_optimize_refine(o, &node);
+  vote_mapping_del(node.mapping);
+}
+
+
+/**
+ * Allocate the state of a search, and enqueue the query region.
+ **/
+static void
+vote_optimize_init(vote_optimize_t *o, const vote_ensemble_t *e,
+		   const vote_bound_t *inputs, size_t output,
+		   vote_optimize_goal_t goal) {
+  vote_mapping_t *m = vote_mapping_new(e->nb_inputs, e->nb_outputs);
+
+  assert(output < e->nb_outputs);
+
+  memset(o, 0, sizeof(vote_optimize_t));
+  o->ensemble = e;
+  o->output = output;
+  o->goal = goal;
+
+  o->trees = calloc(e->nb_trees + 1, sizeof(vote_tree_t*));
+  assert(o->trees);
+
+  o->witness = calloc(e->nb_inputs + 1, sizeof(vote_bound_t));
+  assert(o->witness);
+
+  o->hull = calloc(e->nb_outputs + 1, sizeof(vote_bound_t));
+  assert(o->hull);
+
+  o->outputs = calloc(e->nb_outputs + 1, sizeof(vote_bound_t));
+  assert(o->outputs);
+
+  o->point = calloc(e->nb_inputs + 1, sizeof(real_t));
+  assert(o->point);
+
+  o->values = calloc(e->nb_outputs + 1, sizeof(real_t));
+  assert(o->values);
+
+  memcpy(o->trees, e->trees, e->nb_trees * sizeof(vote_tree_t*));
+  vote_order_sort(o->trees, e->nb_trees, e->order, inputs);
+
+  // an empty query region leaves nothing to search
+  for(size_t i=0; i<e->nb_inputs; i++) {
+    if(inputs[i].lower > inputs[i].upper) {
+      vote_mapping_del(m);
+      return;
+    }
+  }
+
+  memcpy(m->inputs, inputs, e->nb_inputs * sizeof(vote_bound_t));
+  vote_optimize_push(o, vote_optimize_bound(o, m, 0), 0, m);
+}
+
+
+/**
+ * Free the resources of a search, including regions that remain open.
+ **/
+static void
+vote_optimize_fini(vote_optimize_t *o) {
+  while(o->nb_open) {
+    vote_mapping_del(o->open[--o->nb_open].mapping);
+  }
+
+  free(o->open);
+  free(o->trees);
+  free(o->witness);
+  free(o->hull);
+  free(o->outputs);
+  free(o->point);
+  free(o->values);
+}
+
+
+/**
+ * Optimize an output of an ensemble in an input region, best-first in the
+ * order of the bounds of open regions. The search stops when no open region
+ * can improve on the incumbent, or when the progress callback asks it to.
+ *
+ * Returns true if the incumbent is the optimum.
+ **/
+static bool
+vote_optimize_output(const vote_ensemble_t *e, const vote_bound_t *inputs,
+		     size_t output, vote_optimize_goal_t goal, real_t *best,
+		     vote_bound_t *witness, vote_progress_cb_t *cb, void *ctx) {
+  bool minimize = goal == VOTE_OPTIMIZE_MINIMIZE;
+  bool optimal = true;
+  vote_optimize_t o;
+
+  vote_optimize_init(&o, e, inputs, output, goal);
+
+  while(o.nb_open && !vote_optimize_prunable(&o, o.open[0].bound)) {
+    vote_optimize_expand(&o);
+
+    if(cb && o.found && o.nb_open && o.open[0].bound > o.incumbent) {
+      if(!cb(ctx, minimize ? -o.incumbent : o.incumbent,
+	     minimize ? -o.open[0].bound : o.open[0].bound)) {
+	optimal = false;
+	break;
+      }
+    }
+  }
+
+  // no value is attained in an empty region
+  if(!o.found) {
+    o.incumbent = -VOTE_INFINITY;
+    optimal = false;
+  }
+
+  *best = minimize ? -o.incumbent : o.incumbent;
+  if(witness && o.found) {
+    memcpy(witness, o.witness, e->nb_inputs * sizeof(vote_bound_t));
+  }
+
+  vote_optimize_fini(&o);
+
+  return optimal;
+}
+
+
+/**
+ * Get the number of seconds elapsed since some point in time.
+ **/
+static double
+vote_optimize_elapsed(const struct timespec *start) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (double)(now.tv_sec - start->tv_sec) +
+    (double)(now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+
+vote_mapping_t*
+vote_ensemble_approximate_anytime(const vote_ensemble_t *e,
+				  const vote_bound_t *inputs,
+				  size_t max_nodes, double max_seconds) {
+  vote_mapping_t *m = vote_mapping_new(e->nb_inputs, e->nb_outputs);
+  struct timespec start;
+  vote_optimize_t o;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  vote_optimize_init(&o, e, inputs, 0, VOTE_OPTIMIZE_TIGHTEN);
+
+  while(o.nb_open) {
+    if(max_nodes && o.nb_expanded >= max_nodes) {
+      break;
+    }
+    if(max_seconds > 0 && vote_optimize_elapsed(&start) >= max_seconds) {
+      break;
+    }
+    vote_optimize_expand(&o);
+  }
+
+  // the regions that remain open are joined with the settled ones
+  for(size_t i=0; i<o.nb_open; i++) {
+    const vote_optimize_node_t *node = &o.open[i];
+
+    vote_optimize_bound(&o, node->mapping, node->depth);
+    vote_optimize_join(&o);
+  }
+
+  memcpy(m->inputs, inputs, e->nb_inputs * sizeof(vote_bound_t));
+  memcpy(m->outputs, o.hull, e->nb_outputs * sizeof(vote_bound_t));
+
+  vote_optimize_fini(&o);
+
+  return m;
+}
+
+
+bool
+vote_ensemble_maximize(const vote_ensemble_t *e, const vote_bound_t *inputs,
+		       size_t output, real_t *best, vote_bound_t *witness) {
+  return vote_optimize_output(e, inputs, output, VOTE_OPTIMIZE_MAXIMIZE, best,
+			      witness, NULL, NULL);
+}
+
+
+bool
+vote_ensemble_minimize(const vote_ensemble_t *e, const vote_bound_t *inputs,
+		       size_t output, real_t *best, vote_bound_t *witness) {
+  return vote_optimize_output(e, inputs, output, VOTE_OPTIMIZE_MINIMIZE, best,
+			      witness, NULL, NULL);
+}
+
+
+bool
+vote_ensemble_maximize_anytime(const vote_ensemble_t *e,
+			       const vote_bound_t *inputs, size_t output,
+			       real_t *best, vote_bound_t *witness,
+			       vote_progress_cb_t *cb, void *ctx) {
+  return vote_optimize_output(e, inputs, output, VOTE_OPTIMIZE_MAXIMIZE, best,
+			      witness, cb, ctx);
+}
+
+
+bool
+vote_ensemble_minimize_anytime(const vote_ensemble_t *e,
+			       const vote_bound_t *inputs, size_t output,
+			       real_t *best, vote_bound_t *witness,
+			       vote_progress_cb_t *cb, void *ctx) {
+  return vote_optimize_output(e, inputs, output, VOTE_OPTIMIZE_MINIMIZE, best,
+			      witness, cb, ctx);
+}
@@ -0,0 +1,198 @@
+/* Copyright (C) 2021 John Törnblom
+
+   This file is part of VoTE (Verifier of Tree Ensembles).
+
+VoTE is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+VoTE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or
+FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with VoTE; see the files COPYING and COPYING.LESSER. If not,
+see <http://www.gnu.org/licenses/>.  */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vote.h"
+#include "vote_order.h"
+#include "vote_abstract.h"
+#include "vote_math.h"
+
+
+/**
+ * A tree together with its score and position, used when sorting trees.
+ **/
+typedef struct vote_order_entry {
+  vote_tree_t *tree;
+  real_t       score;
+  size_t       position;
+} vote_order_entry_t;
+
+
+/**
+ * Count the leaves below a node that are reachable from an input region.
+ **/
+static size_t
+vote_order_leaves(const vote_tree_t *t, size_t node_id,
+		  const vote_bound_t *inputs) {
+  const vote_node_t *n = &t->nodes[node_id];
+  size_t nb_leaves = 0;
+
+  if(vote_node_is_leaf(n)) {
+    return 1;
+  }
+
+  // left: [lower, threshold]
+  if(inputs[n->feature].lower <= n->threshold) {
+    nb_leaves += vote_order_leaves(t, (size_t)n->child, inputs);
+  }
+
+  // right: (threshold, upper]
+  if(inputs[n->feature].upper > n->threshold) {
+    nb_leaves += vote_order_leaves(t, (size_t)n->child + 1, inputs);
+  }
+
+  return nb_leaves;
+}
+
+
+/**
+ * Compute the total width of the join of the outputs of a tree over an input
+ * region.
+ **/
+static real_t
+vote_order_width(const vote_tree_t *t, const vote_bound_t *inputs) {
+  vote_bound_t outputs[t->nb_values];
+  real_t width = 0;
+
+  vote_abstract_join_tree(t, inputs, t->nb_inputs, outputs);
+
+  for(size_t i=0; i<t->nb_values; i++) {
+    width += outputs[i].upper - outputs[i].lower;
+  }
+
+  return width;
+}
+
+
+/**
+ * Order entries by ascending score, and then by position.
+ **/
+static int
+vote_order_cmp(const void *a, const void *b) {
+  const vote_order_entry_t *ea = (const vote_order_entry_t*)a;
+  const vote_order_entry_t *eb = (const vote_order_entry_t*)b;
+
+  if(ea->score != eb->score) {
+    return (ea->score > eb->score) - (ea->score < eb->score);
+  }
+
+  return (ea->position > eb->position) - (ea->position < eb->position);
+}
+
+
+real_t
+vote_order_score(const vote_tree_t *t, vote_order_t order,
+		 const vote_bound_t *inputs) {
+  switch(order) {
+  case VOTE_ORDER_LEAVES:
+    return (real_t)vote_order_leaves(t, 0, inputs);
+
+  case VOTE_ORDER_WIDTH:
+    return -vote_order_width(t, inputs);
+
+  default:
+    return 0;
+  }
+}
+
+
+size_t
+vote_order_pick(vote_tree_t *const*trees, size_t nb_trees,
+		vote_order_t order, const vote_bound_t *inputs) {
+  size_t best = 0;
+  real_t best_score = VOTE_INFINITY;
+
+  for(size_t i=0; i<nb_trees; i++) {
+    real_t score = vote_order_score(trees[i], order, inputs);
+
+    if(score < best_score) {
+      best_score = score;
+      best = i;
+    }
+  }
+
+  return best;
+}
+
+
+void
+vote_order_sort(vote_tree_t **trees, size_t nb_trees,
+		vote_order_t order, const vote_bound_t *inputs) {
+  vote_order_entry_t *entries = calloc(nb_trees + 1, sizeof(vote_order_entry_t));
+  assert(entries);
+
+  for(size_t i=0; i<nb_trees; i++) {
+    entries[i].tree = trees[i];
+    entries[i].score = vote_order_score(trees[i], order, inputs);
+    entries[i].position = i;
+  }
+
+  qsort(entries, nb_trees, sizeof(vote_order_entry_t), vote_order_cmp);
+
+  for(size_t i=0; i<nb_trees; i++) {
+    trees[i] = entries[i].tree;
+  }
+
+  free(entries);
+}
+
+
+real_t
+vote_order_margin(const vote_tree_t *t, size_t node_id,
+		  const vote_mapping_t *m) {
+  const vote_node_t *n = &t->nodes[node_id];
+  const vote_bound_t *join = NULL;
+  const real_t *value = NULL;
+  vote_bound_t outputs[m->nb_outputs];
+  real_t upper = -VOTE_INFINITY;
+  size_t lead = 0;
+
+  memcpy(outputs, m->outputs, m->nb_outputs * sizeof(vote_bound_t));
+  
+  if(vote_node_is_leaf(n)) {
+    value = vote_node_value(t, n);
+  } else {
+    join = vote_node_join(t, node_id);
+  }
+
+  for(size_t i=0; i<t->nb_values; i++) {
+    outputs[t->output + i].lower += value ? value[i] : join[i].lower;
+    outputs[t->output + i].upper += value ? value[i] : join[i].upper;
+  }
+
+  if(m->nb_outputs == 1) {
+    return outputs[0].lower - outputs[0].upper;
+  }
+  
+  for(size_t i=1; i<m->nb_outputs; i++) {
+    if(outputs[i].lower > outputs[lead].lower) {
+      lead = i;
+    }
+  }
+
+  for(size_t i=0; i<m->nb_outputs; i++) {
+    if(i != lead) {
+      upper = vote_max(upper, outputs[i].upper);
+    }
+  }
+
+  return outputs[lead].lower - upper;
+}
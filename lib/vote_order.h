@@ -0,0 +1,62 @@
+/* Copyright (C) 2021 John Törnblom
+
+   This file is part of VoTE (Verifier of Tree Ensembles).
+
+VoTE is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+VoTE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or
+FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with VoTE; see the files COPYING and COPYING.LESSER. If not,
+see <http://www.gnu.org/licenses/>.  */
+
+#ifndef VOTE_ORDER_H
+#define VOTE_ORDER_H
+
+
+#include "vote.h"
+#include "vote_tree.h"
+
+
+/**
+ * Score a tree for an input region according to an ordering heuristic. Trees
+ * with lower scores are refined first.
+ **/
+real_t vote_order_score(const vote_tree_t *t, vote_order_t order,
+			const vote_bound_t *inputs);
+
+
+/**
+ * Find the tree with the lowest score for an input region, i.e. the tree to
+ * refine next. Ties are broken by the position of the trees.
+ **/
+size_t vote_order_pick(vote_tree_t *const*trees, size_t nb_trees,
+		       vote_order_t order, const vote_bound_t *inputs);
+
+
+/**
+ * Sort trees by ascending score for an input region. Ties are broken by the
+ * position of the trees.
+ **/
+void vote_order_sort(vote_tree_t **trees, size_t nb_trees,
+		     vote_order_t order, const vote_bound_t *inputs);
+
+
+/**
+ * Compute how far the output with the largest lower bound would stay ahead
+ * of the remaining outputs of a mapping, if the join of the leaves below a
+ * node was added to the mapping. Nodes with small margins are the most likely
+ * to change the argmax. Mappings with a single output have a margin of minus
+ * the width of that output.
+ **/
+real_t vote_order_margin(const vote_tree_t *t, size_t node_id,
+			 const vote_mapping_t *m);
+
+
+#endif //VOTE_ORDER_H
@@ -0,0 +1,509 @@
+/* Copyright (C) 2021 John Törnblom
+
+   This file is part of VoTE (Verifier of Tree Ensembles).
+
+VoTE is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+VoTE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or
+FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with VoTE; see the files COPYING and COPYING.LESSER. If not,
+see <http://www.gnu.org/licenses/>.  */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vote.h"
+#include "vote_pipeline.h"
+#include "vote_refinary.h"
+#include "vote_abstract.h"
+#include "vote_postproc.h"
+#include "vote_workpool.h"
+#include "vote_order.h"
+#include "vote_budget.h"
+#include "vote_stats.h"
+#include "vote_trace.h"
+
+
+/**
+ * The stride between the counters of mappings of two workers, so that each
+ * counter has a cache line of its own.
+ **/
+#define VOTE_PLAN_STRIDE 8
+
+
+struct vote_plan {
+  const vote_ensemble_t *ensemble;
+  vote_strategy_t        strategy;
+  vote_tree_t          **trees;
+  vote_pipeline_t       *head;
+  vote_iter_t           *iter;
+  vote_workpool_t       *pool;
+  vote_mapping_t        *mapping;
+  vote_bound_t          *suffix;
+  vote_budget_t         *budget;
+  vote_counters_t      **counters;
+  size_t                *nb_mappings;
+  vote_mapping_cb_t     *user_cb;
+  void                  *user_ctx;
+  bool                   failed;
+};
+
+
+/**
+ * Forward a mapping that leaves the pipeline to the callback of the current
+ * run of a plan, unless the run has exhausted its budget.
+ **/
+static vote_outcome_t
+vote_plan_output(void *ctx, vote_mapping_t *m) {
+  vote_plan_t *p = (vote_plan_t*)ctx;
+  vote_outcome_t o;
+
+  if(!vote_budget_mapping(p->budget)) {
+    return VOTE_FAIL;
+  }
+
+  if(p->nb_mappings) {
+    size_t worker = p->pool ? vote_workpool_worker(p->pool) : 0;
+    p->nb_mappings[worker * VOTE_PLAN_STRIDE]++;
+  }
+
+  VOTE_TRACE(VOTE_TRACE_CALLBACK, o = p->user_cb(p->user_ctx, m));
+
+  // a counterexample, as opposed to a run that was stopped by its budget
+  if(o == VOTE_FAIL) {
+    __atomic_store_n(&p->failed, true, __ATOMIC_RELAXED);
+  }
+
+  return o;
+}
+
+
+/**
+ * Get the counters of a tree if the plan collects statistics, or NULL.
+ **/
+static vote_counters_t*
+vote_plan_counters(const vote_plan_t *p, const vote_tree_t *t) {
+  const vote_ensemble_t *e = p->ensemble;
+
+  if(!p->counters) {
+    return NULL;
+  }
+
+  // statistics are kept in the order of the ensemble, not of the refinement
+  for(size_t i=0; i<e->nb_trees; i++) {
+    if(e->trees[i] == t) {
+      return p->counters[i];
+    }
+  }
+
+  assert(false);
+  return NULL;
+}
+
+
+/**
+ * Create a pipeline that refines all trees of a plan, one at the time.
+ **/
+static vote_pipeline_t*
+vote_plan_refine_pipeline(vote_plan_t *p) {
+  const vote_ensemble_t *e = p->ensemble;
+  vote_pipeline_t *head = vote_postproc_pipeline(e, p, vote_plan_output);
+
+  for(size_t i=0; i<e->nb_trees; i++) {
+    const vote_tree_t *t = p->trees[e->nb_trees-i-1];
+    vote_pipeline_t *sink = head;
+    head = vote_refinary_pipeline(t, e->search, p->pool, p->budget,
+				  vote_plan_counters(p, t));
+    vote_pipeline_connect(head, sink);
+  }
+
+  return head;
+}
+
+
+/**
+ * Create a pipeline that interleaves abstraction and refinement of trees,
+ * optionally bypassing the refinement of trees with classes that can no longer
+ * be the argmax.
+ **/
+static vote_pipeline_t*
+vote_plan_absref_pipeline(vote_plan_t *p, bool classwise) {
+  const vote_ensemble_t *e = p->ensemble;
+  vote_pipeline_t *pp = vote_postproc_pipeline(e, p, vote_plan_output);
+  vote_abstract_index_t *index = vote_abstract_index_new(p->trees, e->nb_trees);
+  vote_pipeline_t *head = NULL;
+  vote_pipeline_t *tail = NULL;
+
+  if(e->suffix_bounds) {
+    p->suffix = calloc((e->nb_trees + 1) * e->nb_outputs, sizeof(vote_bound_t));
+    assert(p->suffix);
+  }
+  
+  for(size_t i=0; i<e->nb_trees; i++) {
+    vote_counters_t *counters = vote_plan_counters(p, p->trees[i]);
+    const vote_bound_t *suffix = NULL;
+    vote_pipeline_t *ref;
+    vote_pipeline_t *abs;
+
+    // the first component sees the query region itself, where the suffix
+    // bounds are no looser than its own join
+    if(p->suffix && i) {
+      suffix = &p->suffix[i * e->nb_outputs];
+    }
+
+    ref = vote_refinary_pipeline(p->trees[i], e->search, p->pool, p->budget,
+				 counters);
+    abs = vote_abstract_pipeline(&p->trees[i], e->nb_trees - i, index,
+				 e->domain, suffix, pp,
+				 classwise ? ref : NULL, p->pool, p->budget,
+				 counters);
+    vote_pipeline_connect(abs, ref);
+
+    if(tail) {
+      vote_pipeline_connect(tail, abs);
+    }
+    if(!head) {
+      head = abs;
+    }
+
+    tail = ref;
+  }
+
+  vote_pipeline_connect(tail, pp);
+  vote_abstract_index_del(index);
+
+  return head;
+}
+
+
+/**
+ * Bound the sum of the outputs of the trees i..n over a query region for each
+ * tree i, starting from the last one.
+ **/
+static void
+vote_plan_suffix(vote_plan_t *p, const vote_bound_t *inputs) {
+  const vote_ensemble_t *e = p->ensemble;
+  const size_t nb_outputs = e->nb_outputs;
+  vote_bound_t tree_outputs[nb_outputs];
+
+  memset(&p->suffix[e->nb_trees * nb_outputs], 0,
+	 nb_outputs * sizeof(vote_bound_t));
+  
+  for(size_t i=e->nb_trees; i>0; i--) {
+    const vote_tree_t *t = p->trees[i - 1];
+    vote_bound_t *sum = &p->suffix[(i - 1) * nb_outputs];
+    
+    memcpy(sum, &sum[nb_outputs], nb_outputs * sizeof(vote_bound_t));
+    vote_abstract_join_tree(t, inputs, e->nb_inputs, tree_outputs);
+    
+    for(size_t dim=0; dim<t->nb_values; dim++) {
+      sum[t->output + dim].lower += tree_outputs[dim].lower;
+      sum[t->output + dim].upper += tree_outputs[dim].upper;
+    }
+  }
+}
+
+
+/**
+ * Create the pipeline of a plan for the current order of its trees.
+ **/
+static void
+vote_plan_build(vote_plan_t *p) {
+  // the bounds of softmax and sigmoid outputs do not preserve the order of
+  // the class bounds they are computed from, unless left as logits
+  if(p->strategy == VOTE_STRATEGY_CLASSWISE) {
+    p->head = vote_plan_absref_pipeline(p, vote_postproc_ordered(p->ensemble));
+  } else if(p->strategy == VOTE_STRATEGY_ABSREF) {
+    p->head = vote_plan_absref_pipeline(p, false);
+  } else {
+    p->head = vote_plan_refine_pipeline(p);
+  }
+}
+
+
+/**
+ * Replace the pipeline of a plan, if it has one.
+ **/
+static void
+vote_plan_rebuild(vote_plan_t *p) {
+  if(!p->head) {
+    return;
+  }
+
+  vote_pipeline_del(p->head);
+  free(p->suffix);
+  p->suffix = NULL;
+  vote_plan_build(p);
+}
+
+
+/**
+ * Order the trees of a plan for a query region, and rebuild the pipeline if
+ * the order changed.
+ **/
+static void
+vote_plan_order(vote_plan_t *p, const vote_bound_t *inputs) {
+  const vote_ensemble_t *e = p->ensemble;
+  vote_tree_t *trees[e->nb_trees + 1];
+
+  memcpy(trees, e->trees, e->nb_trees * sizeof(vote_tree_t*));
+  vote_order_sort(trees, e->nb_trees, e->order, inputs);
+
+  if(!memcmp(trees, p->trees, e->nb_trees * sizeof(vote_tree_t*))) {
+    return;
+  }
+
+  memcpy(p->trees, trees, e->nb_trees * sizeof(vote_tree_t*));
+  vote_plan_rebuild(p);
+}
+
+
+/**
+ * Stimulate the head of a pipeline from a worker thread.
+ **/
+static bool
+vote_plan_task(const void *ctx, size_t node_id, vote_mapping_t *m) {
+  const vote_pipeline_t *head = (const vote_pipeline_t*)ctx;
+
+  VOTE_UNUSED(node_id);
+
+  return vote_pipeline_input(head, m) == VOTE_PASS;
+}
+
+
+vote_plan_t*
+vote_plan_new(const vote_ensemble_t *e, vote_strategy_t strategy,
+	      size_t nb_threads) {
+  vote_plan_t *p = calloc(1, sizeof(vote_plan_t));
+  assert(p);
+
+  p->ensemble = e;
+  p->strategy = strategy;
+  p->mapping = vote_mapping_new(e->nb_inputs, e->nb_outputs);
+
+  p->trees = calloc(e->nb_trees + 1, sizeof(vote_tree_t*));
+  assert(p->trees);
+  
+  memcpy(p->trees, e->trees, e->nb_trees * sizeof(vote_tree_t*));
+  
+  // without a pool, the plan runs on the calling thread
+  if(nb_threads != 1) {
+    p->pool = vote_workpool_new(nb_threads);
+  }
+
+  p->budget = vote_budget_new(vote_plan_size(p));
+
+  // the iterator only visits the child with the least input space first
+  if(strategy == VOTE_STRATEGY_REFINE && !p->pool &&
+     e->search == VOTE_SEARCH_SMALL_FIRST) {
+    p->iter = vote_iter_new(e, p->mapping->inputs);
+  } else {
+    vote_plan_build(p);
+  }
+
+  return p;
+}
+
+
+void
+vote_plan_del(vote_plan_t *p) {
+  if(p->head) {
+    vote_pipeline_del(p->head);
+    p->head = NULL;
+  }
+  if(p->iter) {
+    vote_iter_del(p->iter);
+  }
+
+  vote_plan_set_stats(p, false);
+  vote_mapping_del(p->mapping);
+  vote_budget_del(p->budget);
+  free(p->suffix);
+  free(p->trees);
+
+  if(p->pool) {
+    vote_workpool_del(p->pool);
+  }
+
+  free(p);
+}
+
+
+/**
+ * Iterate the mappings of a plan with its iterator, and forward them to the
+ * callback of the run like mappings that leave the pipeline, i.e. charged to
+ * the budget, counted and traced.
+ **/
+static bool
+vote_plan_iterate(vote_plan_t *p, const vote_bound_t *inputs,
+		  vote_mapping_cb_t *cb, void *ctx) {
+  vote_mapping_t *m;
+
+  p->user_cb = cb;
+  p->user_ctx = ctx;
+
+  vote_iter_reset(p->iter, inputs);
+  while((m = vote_iter_next(p->iter))) {
+    if(vote_plan_output(p, m) != VOTE_PASS) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+/**
+ * Run a plan for an input region with the budget of the current run.
+ **/
+static bool
+vote_plan_execute(vote_plan_t *p, const vote_bound_t *inputs,
+		  vote_mapping_cb_t *cb, void *ctx, bool count_nodes) {
+  vote_mapping_t *m = p->mapping;
+
+  // refine on the calling thread without recursing through the pipeline,
+  // unless nodes must be counted, which only refinery components do
+  if(p->iter && !count_nodes && !p->counters) {
+    return vote_plan_iterate(p, inputs, cb, ctx);
+  }
+
+  if(!p->head) {
+    vote_plan_build(p);
+  }
+
+  p->user_cb = cb;
+  p->user_ctx = ctx;
+
+  if(p->ensemble->order != VOTE_ORDER_FILE) {
+    vote_plan_order(p, inputs);
+  }
+
+  memcpy(m->inputs, inputs, m->nb_inputs * sizeof(vote_bound_t));
+  memset(m->outputs, 0, m->nb_outputs * sizeof(vote_bound_t));
+
+  if(p->suffix) {
+    vote_plan_suffix(p, inputs);
+  }
+  
+  if(!p->pool) {
+    return vote_pipeline_input(p->head, m) == VOTE_PASS;
+  }
+
+  // the pool takes ownership of the mapping
+  return vote_workpool_run(p->pool, vote_plan_task, p->head, 0,
+			   vote_mapping_copy(m));
+}
+
+
+bool
+vote_plan_run(vote_plan_t *p, const vote_bound_t *inputs,
+	      vote_mapping_cb_t *cb, void *ctx) {
+  vote_budget_reset(p->budget, NULL);
+
+  return vote_plan_execute(p, inputs, cb, ctx, false);
+}
+
+
+vote_outcome_t
+vote_plan_run_limited(vote_plan_t *p, const vote_bound_t *inputs,
+		      vote_mapping_cb_t *cb, void *ctx,
+		      const vote_limits_t *limits) {
+  bool res;
+
+  vote_budget_reset(p->budget, limits);
+  p->failed = false;
+  res = vote_plan_execute(p, inputs, cb, ctx, limits && limits->max_nodes);
+
+  // other workers may exhaust the budget after a callback failed
+  if(!res && p->failed) {
+    return VOTE_FAIL;
+  }
+
+  if(vote_budget_exhausted(p->budget)) {
+    return VOTE_EXHAUSTED;
+  }
+
+  return res ? VOTE_PASS : VOTE_FAIL;
+}
+
+
+size_t
+vote_plan_size(const vote_plan_t *p) {
+  return p->pool ? vote_workpool_size(p->pool) : 1;
+}
+
+
+void
+vote_plan_tasks(const vote_plan_t *p, size_t *nb_tasks) {
+  if(p->pool) {
+    vote_workpool_tasks(p->pool, nb_tasks);
+  } else {
+    nb_tasks[0] = 1;
+  }
+}
+
+
+void
+vote_plan_set_stats(vote_plan_t *p, bool enabled) {
+  const vote_ensemble_t *e = p->ensemble;
+  size_t nb_workers = vote_plan_size(p);
+
+  if(enabled == (p->counters != NULL)) {
+    return;
+  }
+
+  if(enabled) {
+    p->counters = calloc(e->nb_trees + 1, sizeof(vote_counters_t*));
+    assert(p->counters);
+
+    for(size_t i=0; i<e->nb_trees; i++) {
+      p->counters[i] = vote_counters_new(nb_workers);
+    }
+
+    p->nb_mappings = calloc(nb_workers * VOTE_PLAN_STRIDE, sizeof(size_t));
+    assert(p->nb_mappings);
+  } else {
+    for(size_t i=0; i<e->nb_trees; i++) {
+      vote_counters_del(p->counters[i]);
+    }
+
+    free(p->counters);
+    free(p->nb_mappings);
+    p->counters = NULL;
+    p->nb_mappings = NULL;
+  }
+
+  vote_plan_rebuild(p);
+}
+
+
+void
+vote_plan_stats(const vote_plan_t *p, vote_stats_t *stats) {
+  const vote_ensemble_t *e = p->ensemble;
+
+  if(!p->counters) {
+    return;
+  }
+
+  assert(stats->nb_trees == e->nb_trees);
+
+  for(size_t i=0; i<e->nb_trees; i++) {
+    vote_tree_stats_t sum = {0};
+
+    vote_counters_merge(p->counters[i], &sum);
+    vote_tree_stats_add(&stats->trees[i], &sum);
+    vote_tree_stats_add(&stats->total, &sum);
+  }
+
+  for(size_t i=0; i<vote_plan_size(p); i++) {
+    stats->nb_mappings += p->nb_mappings[i * VOTE_PLAN_STRIDE];
+  }
+}
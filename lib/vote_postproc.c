@@ -19,9 +19,11 @@ see <http://www.gnu.org/licenses/>.  */
 
 #include <stdlib.h>
 #include <assert.h>
+#include <string.h>
 
 #include "vote_postproc.h"
 #include "vote_math.h"
+#include "vote_trace.h"
 
 
 typedef struct vote_postproc {
@@ -120,15 +122,75 @@ vote_ensemble_postproc(const vote_ensemble_t *e, vote_bound_t *outputs) {
 
 
 /**
- * Apply a post processing algorithm on a mapping.
+ * Check if a post-processing algorithm may be deferred to callbacks.
+ **/
+static bool
+vote_postproc_deferred(const vote_ensemble_t *e) {
+  return e->postproc_mode == VOTE_POSTPROC_LAZY &&
+    (e->post_process == VOTE_POST_PROCESS_SOFTMAX ||
+     e->post_process == VOTE_POST_PROCESS_SIGMOID);
+}
+
+
+void
+vote_postproc_mapping(const vote_ensemble_t *e, vote_mapping_t *m) {
+  if(vote_postproc_deferred(e)) {
+    m->post_process = e->post_process;
+  } else {
+    vote_ensemble_postproc(e, m->outputs);
+    m->post_process = VOTE_POST_PROCESS_NONE;
+  }
+}
+
+
+bool
+vote_postproc_ordered(const vote_ensemble_t *e) {
+  return vote_postproc_deferred(e) ||
+    e->post_process == VOTE_POST_PROCESS_NONE ||
+    e->post_process == VOTE_POST_PROCESS_DIVISOR;
+}
+
+
+void
+vote_mapping_postproc(vote_mapping_t *m) {
+  switch(m->post_process) {
+  case VOTE_POST_PROCESS_SOFTMAX:
+    vote_bound_softmax(m->outputs, m->nb_outputs);
+    break;
+
+  case VOTE_POST_PROCESS_SIGMOID:
+    vote_bound_sigmoid(m->outputs, m->nb_outputs);
+    break;
+
+  default:
+    break;
+  }
+
+  m->post_process = VOTE_POST_PROCESS_NONE;
+}
+
+
+/**
+ * Apply a post processing algorithm on a copy of a mapping, leaving the
+ * outputs of the mapping intact for preceding pipeline elements.
  **/
 static vote_outcome_t
 vote_postproc_input(void *ctx, vote_mapping_t *m) {
   vote_postproc_t *pp = (vote_postproc_t*)ctx;
-
-  vote_ensemble_postproc(pp->ensemble, m->outputs);
+  vote_bound_t outputs[m->nb_outputs];
+  vote_mapping_t copy = {
+    .inputs = m->inputs,
+    .outputs = outputs,
+    .nb_inputs = m->nb_inputs,
+    .nb_outputs = m->nb_outputs,
+    .differences = m->differences,
+    .reference = m->reference
+  };
+
+  memcpy(outputs, m->outputs, m->nb_outputs * sizeof(vote_bound_t));
+  VOTE_TRACE(VOTE_TRACE_POSTPROC, vote_postproc_mapping(pp->ensemble, &copy));
   
-  return pp->user_cb(pp->user_ctx, m);
+  return pp->user_cb(pp->user_ctx, &copy);
 }
 
 
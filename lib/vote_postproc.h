@@ -29,6 +29,21 @@ see <http://www.gnu.org/licenses/>.  */
 void vote_ensemble_postproc(const vote_ensemble_t *e, vote_bound_t *outputs);
 
 
+/**
+ * Apply the post-processing function to the outputs of a mapping, or leave
+ * them as logits if the ensemble post processes lazily.
+ **/
+void vote_postproc_mapping(const vote_ensemble_t *e, vote_mapping_t *m);
+
+
+/**
+ * Check if post-processing preserves the order of the output bounds that
+ * callbacks receive, i.e. if an output bound that lies strictly below another
+ * one before post-processing still does so afterwards.
+ **/
+bool vote_postproc_ordered(const vote_ensemble_t *e);
+
+
 /**
  * Create a post-processing component for a pipeline.
  **/
@@ -23,48 +23,105 @@ see <http://www.gnu.org/licenses/>.  */
 #include "vote.h"
 #include "vote_pipeline.h"
 #include "vote_refinary.h"
+#include "vote_workpool.h"
+#include "vote_order.h"
 #include "vote_math.h"
+#include "vote_trace.h"
+
+
+/**
+ * The largest number of regions that a best-first refinement keeps open.
+ **/
+#define VOTE_REFINERY_MAX_OPEN 256
 
 
 typedef struct vote_refinery {
   const vote_tree_t     *tree;
   const vote_pipeline_t *pipeline;
+  vote_workpool_t       *pool;
+  vote_budget_t         *budget;
+  vote_counters_t       *counters;
+  vote_search_t          search;
 } vote_refinery_t;
 
 
+/**
+ * An open region of a best-first refinement, i.e. a node together with the
+ * mapping that reaches it, and the margin of the node for that mapping.
+ **/
+typedef struct vote_refinery_open {
+  real_t          margin;
+  size_t          node_id;
+  vote_mapping_t *mapping;
+} vote_refinery_open_t;
+
+
 static bool vote_refinery_decend(const vote_refinery_t *r, size_t node_id,
 				 vote_mapping_t *m);
 
 
+/**
+ * Count a node visited by a refinery that collects statistics.
+ **/
+static inline void
+vote_refinery_count(const vote_refinery_t *r, const vote_node_t *n) {
+  if(r->counters) {
+    vote_tree_stats_t *s = vote_counters_local(r->counters, r->pool);
+    s->nb_nodes++;
+    s->nb_leaves += vote_node_is_leaf(n);
+  }
+}
+
+
+/**
+ * Pass a mapping on to the next pipeline element with the value of a leaf
+ * added to its outputs. The outputs that the tree contributes to are logged
+ * before the addition and restored afterwards, so that the outputs never need
+ * to be saved before a split. Splits hence only restore the single input
+ * bound they narrowed, and a leaf costs as many outputs as the tree stores.
+ **/
+static bool
+vote_refinery_emit(const vote_refinery_t *r, const vote_node_t *n,
+		   vote_mapping_t *m) {
+  const vote_tree_t *t = r->tree;
+  const real_t *value = vote_node_value(t, n);
+  vote_bound_t *outputs = &m->outputs[t->output];
+  vote_bound_t trail[t->nb_values];
+  bool res;
+
+  for(size_t i=0; i<t->nb_values; i++) {
+    trail[i] = outputs[i];
+    outputs[i].upper += value[i];
+    outputs[i].lower += value[i];
+  }
+
+  res = vote_pipeline_output(r->pipeline, m) == VOTE_PASS;
+  memcpy(outputs, trail, t->nb_values * sizeof(vote_bound_t));
+
+  return res;
+}
+
+
 /**
  * Decend into children of a node, starting with the left child.
  **/
 static bool
 vote_refinery_decend_left(const vote_refinery_t *r, size_t node_id,
 			  vote_mapping_t *m) {
-  const vote_tree_t *t = r->tree;
-  int left_id = t->left[node_id];
-  int right_id = t->right[node_id];
-  real_t threshold = t->threshold[node_id];
-  int dim = t->feature[node_id];
+  const vote_node_t *n = &r->tree->nodes[node_id];
+  size_t left_id = (size_t)n->child;
+  size_t right_id = left_id + 1;
+  real_t threshold = n->threshold;
+  int dim = n->feature;
   real_t lower = m->inputs[dim].lower;
   real_t upper = m->inputs[dim].upper;
  
   // refine left split: [lower, threshold]
   if(lower <= threshold) {
-    vote_bound_t outputs[m->nb_outputs];
-    vote_mapping_t msplit = {
-      .inputs = m->inputs,
-      .outputs = outputs,
-      .nb_inputs = m->nb_inputs,
-      .nb_outputs = m->nb_outputs
-    };
-    memcpy(msplit.outputs, m->outputs, m->nb_outputs * sizeof(vote_bound_t));
-  
     if(upper > threshold) {
-      msplit.inputs[dim].upper = threshold;
+      m->inputs[dim].upper = threshold;
     }
-    if(!vote_refinery_decend(r, left_id, &msplit)) {
+    if(!vote_refinery_decend(r, left_id, m)) {
       return false;
     }
 
@@ -92,30 +149,20 @@ vote_refinery_decend_left(const vote_refinery_t *r, size_t node_id,
 static bool
 vote_refinery_decend_right(const vote_refinery_t *r, size_t node_id,
 			   vote_mapping_t *m) {
-  const vote_tree_t *t = r->tree;
-  int left_id = t->left[node_id];
-  int right_id = t->right[node_id];
-  real_t threshold = t->threshold[node_id];
-  int dim = t->feature[node_id];
+  const vote_node_t *n = &r->tree->nodes[node_id];
+  size_t left_id = (size_t)n->child;
+  size_t right_id = left_id + 1;
+  real_t threshold = n->threshold;
+  int dim = n->feature;
   real_t lower = m->inputs[dim].lower;
   real_t upper = m->inputs[dim].upper;
  
   // refine right split: (threshold, upper]
   if(upper > threshold) {
-    vote_bound_t outputs[m->nb_outputs];
-    vote_mapping_t msplit = {
-      .inputs = m->inputs,
-      .outputs = outputs,
-      .nb_inputs = m->nb_inputs,
-      .nb_outputs = m->nb_outputs
-    };
-      
-    memcpy(msplit.outputs, m->outputs, m->nb_outputs * sizeof(vote_bound_t));
-  
     if(lower < threshold) {
-      msplit.inputs[dim].lower = vote_nextafter(threshold, VOTE_INFINITY);
+      m->inputs[dim].lower = vote_nextafter(threshold, VOTE_INFINITY);
     }
-    if(!vote_refinery_decend(r, right_id, &msplit)) {
+    if(!vote_refinery_decend(r, right_id, m)) {
       return false;
     }
     
@@ -139,32 +186,99 @@ vote_refinery_decend_right(const vote_refinery_t *r, size_t node_id,
 
 
 /**
- * Decend into children of a node, starting with the child with the least input
- * space.
+ * Resume the decent of a forked mapping on some worker thread.
+ **/
+static bool
+vote_refinery_task(const void *ctx, size_t node_id, vote_mapping_t *m) {
+  const vote_refinery_t *r = (const vote_refinery_t*)ctx;
+  return vote_refinery_decend(r, node_id, m);
+}
+
+
+/**
+ * Decend into both children of a node, forking the child with the largest
+ * input space as a task that idle workers may steal.
+ **/
+static bool
+vote_refinery_decend_fork(const vote_refinery_t *r, size_t node_id,
+			  vote_mapping_t *m) {
+  const vote_node_t *n = &r->tree->nodes[node_id];
+  size_t left_id = (size_t)n->child;
+  size_t right_id = left_id + 1;
+  real_t threshold = n->threshold;
+  int dim = n->feature;
+  real_t lower = m->inputs[dim].lower;
+  real_t upper = m->inputs[dim].upper;
+  vote_mapping_t *fork = vote_mapping_copy(m);
+  bool res;
+
+  if(threshold - lower < upper - threshold) {
+    fork->inputs[dim].lower = vote_nextafter(threshold, VOTE_INFINITY);
+    vote_workpool_fork(r->pool, vote_refinery_task, r, right_id, fork);
+
+    m->inputs[dim].upper = threshold;
+    res = vote_refinery_decend(r, left_id, m);
+    m->inputs[dim].upper = upper;
+  } else {
+    fork->inputs[dim].upper = threshold;
+    vote_workpool_fork(r->pool, vote_refinery_task, r, left_id, fork);
+
+    m->inputs[dim].lower = vote_nextafter(threshold, VOTE_INFINITY);
+    res = vote_refinery_decend(r, right_id, m);
+    m->inputs[dim].lower = lower;
+  }
+
+  return res;
+}
+
+
+/**
+ * Check if the left child of a node that is split by a mapping should be
+ * visited before the right one.
+ **/
+static bool
+vote_refinery_left_first(const vote_refinery_t *r, size_t node_id,
+			 const vote_mapping_t *m) {
+  const vote_node_t *n = &r->tree->nodes[node_id];
+  real_t threshold = n->threshold;
+  int dim = n->feature;
+
+  if(r->search == VOTE_SEARCH_SMALL_FIRST) {
+    real_t right_width = m->inputs[dim].upper - threshold;
+    real_t left_width = threshold - m->inputs[dim].lower;
+    return left_width < right_width;
+  }
+
+  return vote_order_margin(r->tree, (size_t)n->child, m) <=
+    vote_order_margin(r->tree, (size_t)n->child + 1, m);
+}
+
+
+/**
+ * Decend into children of a node, starting with the child selected by the
+ * split order of the refinery.
  **/
 static bool
 vote_refinery_decend(const vote_refinery_t *r, size_t node_id,
 		     vote_mapping_t *m) {
   const vote_tree_t *t = r->tree;
-  int left_id = t->left[node_id];
-  int right_id = t->right[node_id];
-  real_t value[m->nb_outputs];
+  const vote_node_t *n = &t->nodes[node_id];
+
+  // some other worker failed, stop
+  if(r->pool && vote_workpool_cancelled(r->pool)) {
+    return false;
+  }
+
+  // out of time or nodes, stop
+  if(r->budget && !vote_budget_node(r->budget, r->pool)) {
+    return false;
+  }
+
+  vote_refinery_count(r, n);
   
   // leaf node encountered, emit mapping
-  if(left_id < 0 || right_id < 0) {
-    assert(left_id < 0 && right_id < 0);
-    
-    memcpy(value, t->value[node_id], m->nb_outputs * sizeof(real_t));
-    if(t->normalize) {
-      vote_normalize(value, m->nb_outputs);
-    }
-    
-    for(size_t i=0; i<m->nb_outputs; i++) {
-      m->outputs[i].upper += value[i];
-      m->outputs[i].lower += value[i];
-    }
-
-    return vote_pipeline_output(r->pipeline, m) == VOTE_PASS;
+  if(vote_node_is_leaf(n)) {
+    return vote_refinery_emit(r, n, m);
   }
 
   //
@@ -172,13 +286,17 @@ vote_refinery_decend(const vote_refinery_t *r, size_t node_id,
   //   |-----------|-----------|
   // lower     threshold     upper
   
-  real_t threshold = t->threshold[node_id];
-  int dim = t->feature[node_id];
+  real_t threshold = n->threshold;
+  int dim = n->feature;
+  bool split = (m->inputs[dim].lower < threshold &&
+		m->inputs[dim].upper > threshold);
 
-  real_t right_width = m->inputs[dim].upper - threshold;
-  real_t left_width = threshold - m->inputs[dim].lower;
+  // both children are feasible, and some worker is looking for work
+  if(r->pool && split && vote_workpool_hungry(r->pool)) {
+    return vote_refinery_decend_fork(r, node_id, m);
+  }
 
-  if(left_width < right_width) {
+  if(!split || vote_refinery_left_first(r, node_id, m)) {
     return vote_refinery_decend_left(r, node_id, m);
   } else {
     return vote_refinery_decend_right(r, node_id, m);
@@ -186,13 +304,152 @@ vote_refinery_decend(const vote_refinery_t *r, size_t node_id,
 }
 
 
+/**
+ * Add an open region to a heap ordered by ascending margin.
+ **/
+static void
+vote_refinery_push(const vote_refinery_t *r, vote_refinery_open_t *heap,
+		   size_t *nb_open, size_t node_id, vote_mapping_t *m) {
+  size_t i = (*nb_open)++;
+  vote_refinery_open_t o = {
+    .margin = vote_order_margin(r->tree, node_id, m),
+    .node_id = node_id,
+    .mapping = m
+  };
+
+  while(i && heap[(i - 1) / 2].margin > o.margin) {
+    heap[i] = heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+
+  heap[i] = o;
+}
+
+
+/**
+ * Remove the open region with the smallest margin from a heap.
+ **/
+static vote_refinery_open_t
+vote_refinery_pop(vote_refinery_open_t *heap, size_t *nb_open) {
+  vote_refinery_open_t top = heap[0];
+  vote_refinery_open_t last = heap[--(*nb_open)];
+  size_t i = 0;
+
+  for(;;) {
+    size_t child = 2 * i + 1;
+    
+    if(child >= *nb_open) {
+      break;
+    }
+    if(child + 1 < *nb_open && heap[child + 1].margin < heap[child].margin) {
+      child++;
+    }
+    if(heap[child].margin >= last.margin) {
+      break;
+    }
+    
+    heap[i] = heap[child];
+    i = child;
+  }
+
+  heap[i] = last;
+  
+  return top;
+}
+
+
+/**
+ * Refine a tree best-first, i.e. always split the open region with the
+ * smallest margin next. Once there is no room for the children of a region,
+ * that region is refined depth-first.
+ **/
+static bool
+vote_refinery_best_first(const vote_refinery_t *r, vote_mapping_t *m) {
+  vote_refinery_open_t *heap;
+  size_t nb_open = 0;
+  bool res = true;
+
+  // refineries of later trees nest within this one, keep the stack small
+  heap = calloc(VOTE_REFINERY_MAX_OPEN, sizeof(vote_refinery_open_t));
+  assert(heap);
+
+  vote_refinery_push(r, heap, &nb_open, 0, vote_mapping_copy(m));
+
+  while(res && nb_open) {
+    vote_refinery_open_t o = vote_refinery_pop(heap, &nb_open);
+    const vote_node_t *n = &r->tree->nodes[o.node_id];
+
+    if(r->pool && vote_workpool_cancelled(r->pool)) {
+      res = false;
+      
+    } else if(r->budget && !vote_budget_node(r->budget, r->pool)) {
+      res = false;
+      
+    } else if(vote_node_is_leaf(n)) {
+      vote_refinery_count(r, n);
+      res = vote_refinery_emit(r, n, o.mapping);
+      
+    } else if(nb_open + 2 > VOTE_REFINERY_MAX_OPEN) {
+      res = vote_refinery_decend(r, o.node_id, o.mapping);
+      
+    } else {
+      vote_bound_t *input = &o.mapping->inputs[n->feature];
+      bool left = input->lower <= n->threshold;
+      bool right = input->upper > n->threshold;
+
+      vote_refinery_count(r, n);
+
+      // the last feasible child inherits the mapping of its parent
+      if(right) {
+	vote_mapping_t *c = left ? vote_mapping_copy(o.mapping) : o.mapping;
+	if(c->inputs[n->feature].lower < n->threshold) {
+	  c->inputs[n->feature].lower = vote_nextafter(n->threshold,
+						       VOTE_INFINITY);
+	}
+	vote_refinery_push(r, heap, &nb_open, (size_t)n->child + 1, c);
+      }
+      
+      if(left) {
+	if(input->upper > n->threshold) {
+	  input->upper = n->threshold;
+	}
+	vote_refinery_push(r, heap, &nb_open, (size_t)n->child, o.mapping);
+      }
+
+      // a child took ownership of the mapping, unless the region is empty
+      if(left || right) {
+	continue;
+      }
+    }
+
+    vote_mapping_del(o.mapping);
+  }
+
+  while(nb_open) {
+    vote_mapping_del(vote_refinery_pop(heap, &nb_open).mapping);
+  }
+
+  free(heap);
+
+  return res;
+}
+
+
 /**
  * Apply the refining algorithm on a mapping.
  **/
 static vote_outcome_t
 vote_refinery_input(void *ctx, vote_mapping_t *m) {
   vote_refinery_t *r = (vote_refinery_t*)ctx;
-  if(vote_refinery_decend(r, 0, m)) {
+  bool res;
+
+  if(r->search == VOTE_SEARCH_BEST_FIRST) {
+    VOTE_TRACE(VOTE_TRACE_REFINERY, res = vote_refinery_best_first(r, m));
+  } else {
+    VOTE_TRACE(VOTE_TRACE_REFINERY, res = vote_refinery_decend(r, 0, m));
+  }
+  
+  if(res) {
     return VOTE_PASS;
   } else {
     return VOTE_FAIL;
@@ -201,7 +458,9 @@ vote_refinery_input(void *ctx, vote_mapping_t *m) {
 
 
 vote_pipeline_t*
-vote_refinary_pipeline(const vote_tree_t *t) {
+vote_refinary_pipeline(const vote_tree_t *t, vote_search_t search,
+		       vote_workpool_t *pool, vote_budget_t *budget,
+		       vote_counters_t *counters) {
   vote_refinery_t *r = calloc(1, sizeof(vote_refinery_t));
   vote_pipeline_t *p = vote_pipeline_new(r, vote_refinery_input, free);
   
@@ -209,6 +468,10 @@ vote_refinary_pipeline(const vote_tree_t *t) {
 
   r->tree     = t;
   r->pipeline = p;
+  r->pool     = pool;
+  r->budget   = budget;
+  r->counters = counters;
+  r->search   = search;
 
   return p;
 }
@@ -23,12 +23,24 @@ see <http://www.gnu.org/licenses/>.  */
 #include "vote.h"
 #include "vote_tree.h"
 #include "vote_pipeline.h"
+#include "vote_workpool.h"
+#include "vote_budget.h"
+#include "vote_stats.h"
 
 
 /**
- * Create a refinary component for a pipeline.
+ * Create a refinary component for a pipeline that visits the children of the
+ * nodes it splits in a given order. If a pool is given, parts of the
+ * refinement are forked onto idle workers in that pool. If a budget is given,
+ * every node visited is charged to it, and the refinement stops once the
+ * budget is exhausted. If counters are given, the nodes and leaves visited
+ * are counted.
  **/
-vote_pipeline_t* vote_refinary_pipeline(const vote_tree_t *t);
+vote_pipeline_t* vote_refinary_pipeline(const vote_tree_t *t,
+					vote_search_t search,
+					vote_workpool_t *pool,
+					vote_budget_t *budget,
+					vote_counters_t *counters);
 
 
 #endif //VOTE_REFINERY_H
@@ -0,0 +1,118 @@
+/* Copyright (C) 2021 John Törnblom
+
+   This file is part of VoTE (Verifier of Tree Ensembles).
+
+VoTE is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+VoTE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or
+FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with VoTE; see the files COPYING and COPYING.LESSER. If not,
+see <http://www.gnu.org/licenses/>.  */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vote.h"
+#include "vote_stats.h"
+
+
+/**
+ * The size of a cache line.
+ **/
+#define VOTE_STATS_ALIGNMENT 64
+
+
+/**
+ * The counters of a single worker, padded to a cache line of their own.
+ **/
+typedef union vote_counters_slot {
+  vote_tree_stats_t stats;
+  char              pad[VOTE_STATS_ALIGNMENT];
+} vote_counters_slot_t;
+
+
+struct vote_counters {
+  size_t                nb_workers;
+  vote_counters_slot_t *slots;
+};
+
+
+vote_counters_t*
+vote_counters_new(size_t nb_workers) {
+  vote_counters_t *c = calloc(1, sizeof(vote_counters_t));
+  size_t size = nb_workers * sizeof(vote_counters_slot_t);
+
+  assert(c);
+
+  // slots are aligned to cache lines
+  if(posix_memalign((void**)&c->slots, VOTE_STATS_ALIGNMENT, size)) {
+    assert(false);
+  }
+  memset(c->slots, 0, size);
+
+  c->nb_workers = nb_workers;
+
+  return c;
+}
+
+
+void
+vote_counters_del(vote_counters_t *c) {
+  free(c->slots);
+  free(c);
+}
+
+
+vote_tree_stats_t*
+vote_counters_local(vote_counters_t *c, const vote_workpool_t *pool) {
+  return &c->slots[pool ? vote_workpool_worker(pool) : 0].stats;
+}
+
+
+void
+vote_counters_merge(const vote_counters_t *c, vote_tree_stats_t *stats) {
+  for(size_t i=0; i<c->nb_workers; i++) {
+    vote_tree_stats_add(stats, &c->slots[i].stats);
+  }
+}
+
+
+void
+vote_tree_stats_add(vote_tree_stats_t *dst, const vote_tree_stats_t *src) {
+  dst->nb_abstracted += src->nb_abstracted;
+  dst->nb_settled    += src->nb_settled;
+  dst->nb_bypassed   += src->nb_bypassed;
+  dst->nb_refined    += src->nb_refined;
+  dst->nb_nodes      += src->nb_nodes;
+  dst->nb_leaves     += src->nb_leaves;
+}
+
+
+vote_stats_t*
+vote_stats_new(const vote_ensemble_t *e) {
+  vote_stats_t *s = calloc(1, sizeof(vote_stats_t));
+  assert(s);
+
+  s->nb_trees = e->nb_trees;
+  s->trees = calloc(e->nb_trees + 1, sizeof(vote_tree_stats_t));
+  assert(s->trees);
+
+  return s;
+}
+
+
+void
+vote_stats_del(vote_stats_t *s) {
+  free(s->trees);
+  free(s);
+}
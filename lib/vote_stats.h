@@ -0,0 +1,66 @@
+/* Copyright (C) 2021 John Törnblom
+
+   This file is part of VoTE (Verifier of Tree Ensembles).
+
+VoTE is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+VoTE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or
+FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with VoTE; see the files COPYING and COPYING.LESSER. If not,
+see <http://www.gnu.org/licenses/>.  */
+
+#ifndef VOTE_STATS_H
+#define VOTE_STATS_H
+
+
+#include "vote.h"
+#include "vote_workpool.h"
+
+
+/**
+ * Counters that pipeline components update on behalf of a single tree, with
+ * one set of counters per worker so that workers never update the same ones.
+ **/
+typedef struct vote_counters vote_counters_t;
+
+
+/**
+ * Create a new set of counters for a given number of workers.
+ **/
+vote_counters_t* vote_counters_new(size_t nb_workers);
+
+
+/**
+ * Delete a set of counters.
+ **/
+void vote_counters_del(vote_counters_t *c);
+
+
+/**
+ * Get the counters of the calling worker of a pool, or of the calling thread
+ * if there is no pool.
+ **/
+vote_tree_stats_t* vote_counters_local(vote_counters_t *c,
+				       const vote_workpool_t *pool);
+
+
+/**
+ * Add the counters of all workers to some statistics.
+ **/
+void vote_counters_merge(const vote_counters_t *c, vote_tree_stats_t *stats);
+
+
+/**
+ * Add statistics of a tree to some other statistics.
+ **/
+void vote_tree_stats_add(vote_tree_stats_t *dst, const vote_tree_stats_t *src);
+
+
+#endif //VOTE_STATS_H
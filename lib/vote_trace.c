@@ -0,0 +1,264 @@
+/* Copyright (C) 2021 John Törnblom
+
+   This file is part of VoTE (Verifier of Tree Ensembles).
+
+VoTE is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+VoTE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or
+FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with VoTE; see the files COPYING and COPYING.LESSER. If not,
+see <http://www.gnu.org/licenses/>.  */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "vote.h"
+#include "vote_trace.h"
+
+
+#ifdef VOTE_TRACING
+
+/**
+ * The number of spans kept for each thread.
+ **/
+#define VOTE_TRACE_CAPACITY (1 << 16)
+
+
+/**
+ * A span of a stage, in clock readings.
+ **/
+typedef struct vote_trace_event {
+  uint64_t           begin;
+  uint64_t           end;
+  vote_trace_stage_t stage;
+} vote_trace_event_t;
+
+
+/**
+ * A ring buffer with the most recent spans of a thread. Buffers are handed
+ * back when their thread exits, and reused by threads created later, so that
+ * tools that create and delete plans, and with them worker pools, many times
+ * do not pile up buffers.
+ **/
+typedef struct vote_trace_buffer {
+  size_t             id;
+  bool               in_use;
+  size_t             nb_events;
+  vote_trace_event_t events[VOTE_TRACE_CAPACITY];
+} vote_trace_buffer_t;
+
+
+static pthread_once_t        vote_trace_once = PTHREAD_ONCE_INIT;
+static pthread_key_t         vote_trace_key;
+static pthread_mutex_t       vote_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static vote_trace_buffer_t **vote_trace_buffers;
+static size_t                vote_trace_nb_buffers;
+static uint64_t              vote_trace_epoch_clock;
+static uint64_t              vote_trace_epoch_time;
+
+static const char *vote_trace_names[] = {
+  [VOTE_TRACE_ABSTRACT] = "abstract",
+  [VOTE_TRACE_REFINERY] = "refinery",
+  [VOTE_TRACE_POSTPROC] = "postproc",
+  [VOTE_TRACE_CALLBACK] = "callback"
+};
+
+
+/**
+ * Read the monotonic clock in nanoseconds.
+ **/
+static uint64_t
+vote_trace_nanoseconds(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+
+/**
+ * Get the index of the oldest span kept in a buffer.
+ **/
+static size_t
+vote_trace_start(const vote_trace_buffer_t *b) {
+  if(b->nb_events > VOTE_TRACE_CAPACITY) {
+    return b->nb_events - VOTE_TRACE_CAPACITY;
+  }
+
+  return 0;
+}
+
+
+/**
+ * Hand back the buffer of a thread that exits.
+ **/
+static void
+vote_trace_release(void *ctx) {
+  vote_trace_buffer_t *b = (vote_trace_buffer_t*)ctx;
+
+  pthread_mutex_lock(&vote_trace_lock);
+  b->in_use = false;
+  pthread_mutex_unlock(&vote_trace_lock);
+}
+
+
+/**
+ * Set up the thread-local buffers, and take note of the time at which
+ * tracing started, so that clock readings can be converted to time.
+ **/
+static void
+vote_trace_init(void) {
+  pthread_key_create(&vote_trace_key, vote_trace_release);
+  vote_trace_epoch_clock = vote_trace_clock();
+  vote_trace_epoch_time = vote_trace_nanoseconds();
+}
+
+
+/**
+ * Get the buffer of the calling thread, claiming one on first use.
+ **/
+static vote_trace_buffer_t*
+vote_trace_local(void) {
+  vote_trace_buffer_t *b;
+
+  pthread_once(&vote_trace_once, vote_trace_init);
+  if((b = pthread_getspecific(vote_trace_key))) {
+    return b;
+  }
+
+  pthread_mutex_lock(&vote_trace_lock);
+  for(size_t i=0; i<vote_trace_nb_buffers && !b; i++) {
+    if(!vote_trace_buffers[i]->in_use) {
+      b = vote_trace_buffers[i];
+    }
+  }
+
+  if(!b) {
+    b = calloc(1, sizeof(vote_trace_buffer_t));
+    assert(b);
+
+    vote_trace_buffers = realloc(vote_trace_buffers,
+				 (vote_trace_nb_buffers + 1) *
+				 sizeof(vote_trace_buffer_t*));
+    assert(vote_trace_buffers);
+
+    b->id = vote_trace_nb_buffers;
+    vote_trace_buffers[vote_trace_nb_buffers++] = b;
+  }
+
+  b->in_use = true;
+  pthread_mutex_unlock(&vote_trace_lock);
+
+  pthread_setspecific(vote_trace_key, b);
+
+  return b;
+}
+
+
+uint64_t
+vote_trace_clock(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+  uint64_t ticks;
+  __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(ticks));
+  return ticks;
+#else
+  return vote_trace_nanoseconds();
+#endif
+}
+
+
+void
+vote_trace_record(vote_trace_stage_t stage, uint64_t begin) {
+  uint64_t end = vote_trace_clock();
+  vote_trace_buffer_t *b = vote_trace_local();
+  vote_trace_event_t *ev = &b->events[b->nb_events++ % VOTE_TRACE_CAPACITY];
+
+  ev->begin = begin;
+  ev->end = end;
+  ev->stage = stage;
+}
+
+
+bool
+vote_trace_dump(const char *filename) {
+  uint64_t ticks, nanos, origin;
+  double scale = 1;
+  bool first = true;
+  FILE *fp;
+
+  pthread_once(&vote_trace_once, vote_trace_init);
+  ticks = vote_trace_clock();
+  nanos = vote_trace_nanoseconds();
+
+  // microseconds per clock reading, measured over the whole trace
+  if(ticks > vote_trace_epoch_clock) {
+    scale = (double)(nanos - vote_trace_epoch_time) /
+      (double)(ticks - vote_trace_epoch_clock) / 1e3;
+  }
+
+  if(!(fp = fopen(filename, "w"))) {
+    return false;
+  }
+
+  fprintf(fp, "{\"traceEvents\":[");
+
+  pthread_mutex_lock(&vote_trace_lock);
+
+  // spans are placed relative to the earliest one that is kept
+  origin = ticks;
+  for(size_t i=0; i<vote_trace_nb_buffers; i++) {
+    const vote_trace_buffer_t *b = vote_trace_buffers[i];
+
+    for(size_t j=vote_trace_start(b); j<b->nb_events; j++) {
+      const vote_trace_event_t *ev = &b->events[j % VOTE_TRACE_CAPACITY];
+      if(ev->begin < origin) {
+	origin = ev->begin;
+      }
+    }
+  }
+
+  for(size_t i=0; i<vote_trace_nb_buffers; i++) {
+    const vote_trace_buffer_t *b = vote_trace_buffers[i];
+
+    for(size_t j=vote_trace_start(b); j<b->nb_events; j++) {
+      const vote_trace_event_t *ev = &b->events[j % VOTE_TRACE_CAPACITY];
+
+      fprintf(fp, "%s\n{\"name\":\"%s\",\"cat\":\"vote\",\"ph\":\"X\","
+	      "\"pid\":0,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f}",
+	      first ? "" : ",", vote_trace_names[ev->stage], b->id,
+	      (double)(ev->begin - origin) * scale,
+	      (double)(ev->end - ev->begin) * scale);
+      first = false;
+    }
+  }
+  pthread_mutex_unlock(&vote_trace_lock);
+
+  fprintf(fp, "\n],\"displayTimeUnit\":\"ns\"}\n");
+
+  return !fclose(fp);
+}
+
+#else
+
+bool
+vote_trace_dump(const char *filename) {
+  VOTE_UNUSED(filename);
+  return false;
+}
+
+#endif //VOTE_TRACING
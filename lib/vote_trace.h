@@ -0,0 +1,73 @@
+/* Copyright (C) 2021 John Törnblom
+
+   This file is part of VoTE (Verifier of Tree Ensembles).
+
+VoTE is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+VoTE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or
+FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with VoTE; see the files COPYING and COPYING.LESSER. If not,
+see <http://www.gnu.org/licenses/>.  */
+
+#ifndef VOTE_TRACE_H
+#define VOTE_TRACE_H
+
+
+#include <stdint.h>
+
+#include "vote.h"
+
+
+/**
+ * The stages of the pipeline whose latency is traced.
+ **/
+typedef enum vote_trace_stage {
+  VOTE_TRACE_ABSTRACT,
+  VOTE_TRACE_REFINERY,
+  VOTE_TRACE_POSTPROC,
+  VOTE_TRACE_CALLBACK
+} vote_trace_stage_t;
+
+
+#ifdef VOTE_TRACING
+
+/**
+ * Read the clock that spans are measured with, in cycles where the processor
+ * has a cycle counter, and in nanoseconds otherwise.
+ **/
+uint64_t vote_trace_clock(void);
+
+
+/**
+ * Record a span of a stage that began at some clock reading and ends now in
+ * the ring buffer of the calling thread.
+ **/
+void vote_trace_record(vote_trace_stage_t stage, uint64_t begin);
+
+
+/**
+ * Run a statement as a span of a stage.
+ **/
+#define VOTE_TRACE(stage, ...) do {			\
+    uint64_t vote_trace_begin = vote_trace_clock();	\
+    __VA_ARGS__;					\
+    vote_trace_record(stage, vote_trace_begin);		\
+  } while(0)
+
+#else
+
+#define VOTE_TRACE(stage, ...) do {		\
+    __VA_ARGS__;				\
+  } while(0)
+
+#endif //VOTE_TRACING
+
+
+#endif //VOTE_TRACE_H
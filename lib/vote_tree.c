@@ -17,31 +17,32 @@ License along with VoTE; see the files COPYING and COPYING.LESSER. If not,
 see <http://www.gnu.org/licenses/>.  */
 
 
+#define _POSIX_C_SOURCE 200112L
+
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "parson.h"
 
 #include "vote.h"
 #include "vote_tree.h"
+#include "vote_bitvector.h"
+
+
+#define VOTE_TREE_ALIGNMENT 64
 
 
 /**
- * Parse a JSON number array into an array or reals.
+ * Parse a JSON number array into an array of reals.
  **/
 static void
-vote_parse_floats(struct json_array_t *array, real_t** mem, size_t* length) {
-  size_t _length = json_array_get_count(array);
-  real_t* _mem = calloc(_length, sizeof(real_t));
+vote_parse_floats(struct json_array_t *array, real_t* mem, size_t length) {
+  assert(json_array_get_count(array) == length);
   
-  assert(_mem);
-  
-  for(size_t i=0; i<_length; i++) {
-    _mem[i] = (real_t)json_array_get_number(array, i);
+  for(size_t i=0; i<length; i++) {
+    mem[i] = (real_t)json_array_get_number(array, i);
   }
-
-  *length = _length;
-  *mem = _mem;
 }
 
 
@@ -65,18 +66,12 @@ vote_encode_reals(real_t* values, size_t length) {
  * Parse a JSON number array into an array of integers.
  **/
 static void
-vote_parse_ints(struct json_array_t *array, int** mem, size_t* length) {
-  size_t _length = json_array_get_count(array);
-  int* _mem = calloc(_length, sizeof(int));
-  
-  assert(_mem);
+vote_parse_ints(struct json_array_t *array, int* mem, size_t length) {
+  assert(json_array_get_count(array) == length);
   
-  for(size_t i=0; i<_length; i++) {
-    _mem[i] = (int)json_array_get_number(array, i);
+  for(size_t i=0; i<length; i++) {
+    mem[i] = (int)json_array_get_number(array, i);
   }
-
-  *length = _length;
-  *mem = _mem;
 }
 
 
@@ -96,6 +91,315 @@ vote_encode_ints(int* values, size_t length) {
 }
 
 
+vote_tree_t *
+vote_tree_new(size_t nb_nodes, size_t nb_inputs, size_t nb_outputs) {
+  vote_tree_t* tree = calloc(1, sizeof(vote_tree_t));
+  assert(tree);
+
+  tree->nb_nodes = nb_nodes;
+  tree->nb_inputs = nb_inputs;
+  tree->nb_outputs = nb_outputs;
+
+  tree->left = calloc(nb_nodes, sizeof(int));
+  assert(tree->left);
+
+  tree->right = calloc(nb_nodes, sizeof(int));
+  assert(tree->right);
+
+  tree->feature = calloc(nb_nodes, sizeof(int));
+  assert(tree->feature);
+
+  tree->threshold = calloc(nb_nodes, sizeof(real_t));
+  assert(tree->threshold);
+
+  // values of all nodes reside in a single block of memory
+  tree->value = calloc(nb_nodes, sizeof(real_t*));
+  assert(tree->value);
+
+  if(nb_nodes) {
+    tree->value[0] = calloc(nb_nodes * nb_outputs, sizeof(real_t));
+    assert(tree->value[0]);
+  }
+  
+  for(size_t i=1; i<nb_nodes; i++) {
+    tree->value[i] = tree->value[0] + (i * nb_outputs);
+  }
+
+  return tree;
+}
+
+
+/**
+ * Place the children of a node next to each other, followed by the
+ * descendants of the left child, and then the descendants of the right child.
+ **/
+static size_t
+vote_tree_pack_node(vote_tree_t* t, size_t node_id, size_t packed_id,
+		    size_t nb_packed) {
+  vote_node_t *n = &t->nodes[packed_id];
+
+  if(t->left[node_id] < 0 || t->right[node_id] < 0) {
+    assert(t->left[node_id] < 0 && t->right[node_id] < 0);
+      
+    real_t value[t->nb_outputs];
+    
+    n->feature = -1;
+    n->child = (int32_t)t->nb_leaves;
+    memcpy(value, t->value[node_id], t->nb_outputs * sizeof(real_t));
+    if(t->normalize) {
+      vote_normalize(value, t->nb_outputs);
+    }
+    memcpy(vote_node_value(t, n), &value[t->output],
+	   t->nb_values * sizeof(real_t));
+    t->nb_leaves++;
+    
+    return nb_packed;
+  }
+
+  assert(nb_packed + 2 <= t->nb_nodes);
+  
+  n->threshold = t->threshold[node_id];
+  n->feature = t->feature[node_id];
+  n->child = (int32_t)nb_packed;
+
+  nb_packed = vote_tree_pack_node(t, (size_t)t->left[node_id],
+				  (size_t)n->child, nb_packed + 2);
+  nb_packed = vote_tree_pack_node(t, (size_t)t->right[node_id],
+				  (size_t)n->child + 1, nb_packed);
+
+  return nb_packed;
+}
+
+
+/**
+ * Collect the threshold hulls of, and join the leaves below, a packed node.
+ **/
+static void
+vote_tree_span_node(const vote_tree_t* t, size_t node_id, vote_hull_t *hulls,
+		    size_t *nb_hulls, size_t *slot, vote_bound_t *join) {
+  const vote_node_t *n = &t->nodes[node_id];
+
+  if(vote_node_is_leaf(n)) {
+    const real_t *value = vote_node_value(t, n);
+    
+    for(size_t i=0; i<t->nb_values; i++) {
+      join[i].lower = value[i] < join[i].lower ? value[i] : join[i].lower;
+      join[i].upper = value[i] > join[i].upper ? value[i] : join[i].upper;
+    }
+    return;
+  }
+
+  size_t feature = (size_t)n->feature;
+  
+  if(slot[feature] == SIZE_MAX) {
+    hulls[*nb_hulls].feature = n->feature;
+    hulls[*nb_hulls].lower = n->threshold;
+    hulls[*nb_hulls].upper = n->threshold;
+    slot[feature] = (*nb_hulls)++;
+  } else {
+    vote_hull_t *h = &hulls[slot[feature]];
+    h->lower = n->threshold < h->lower ? n->threshold : h->lower;
+    h->upper = n->threshold > h->upper ? n->threshold : h->upper;
+  }
+
+  vote_tree_span_node(t, (size_t)n->child, hulls, nb_hulls, slot, join);
+  vote_tree_span_node(t, (size_t)n->child + 1, hulls, nb_hulls, slot, join);
+}
+
+
+/**
+ * Order threshold hulls by decreasing width.
+ **/
+static int
+vote_hull_cmp(const void *a, const void *b) {
+  const vote_hull_t *ha = (const vote_hull_t*)a;
+  const vote_hull_t *hb = (const vote_hull_t*)b;
+  real_t wa = ha->upper - ha->lower;
+  real_t wb = hb->upper - hb->lower;
+
+  return (wa < wb) - (wa > wb);
+}
+
+
+/**
+ * Annotate the packed nodes of a tree with their threshold hulls and joins.
+ * Wide hulls come first, since they are the least likely to be contained in
+ * an input region.
+ **/
+static void
+vote_tree_span(vote_tree_t* t) {
+  size_t nb_internal = t->nb_nodes - t->nb_leaves;
+  size_t capacity = t->nb_nodes + 1;
+  size_t nb_hulls = 0;
+  vote_hull_t *hulls = calloc(t->nb_inputs + 1, sizeof(vote_hull_t));
+  size_t *slot = calloc(t->nb_inputs + 1, sizeof(size_t));
+
+  assert(hulls);
+  assert(slot);
+
+  free(t->spans);
+  free(t->hulls);
+  free(t->joins);
+
+  t->spans = calloc(t->nb_nodes + 1, sizeof(vote_span_t));
+  assert(t->spans);
+
+  t->hulls = calloc(capacity, sizeof(vote_hull_t));
+  assert(t->hulls);
+
+  t->joins = calloc(nb_internal * t->nb_values + 1, sizeof(vote_bound_t));
+  assert(t->joins);
+
+  // slots of hulls by feature, or SIZE_MAX for features not tested yet
+  for(size_t i=0; i<t->nb_inputs; i++) {
+    slot[i] = SIZE_MAX;
+  }
+  
+  nb_internal = 0;
+  for(size_t i=0; i<t->nb_nodes; i++) {
+    t->spans[i].hull = (uint32_t)nb_hulls;
+    if(vote_node_is_leaf(&t->nodes[i])) {
+      continue;
+    }
+
+    vote_bound_t *join = &t->joins[nb_internal * t->nb_values];
+    t->spans[i].join = (uint32_t)nb_internal++;
+    
+    for(size_t j=0; j<t->nb_values; j++) {
+      join[j].lower = VOTE_INFINITY;
+      join[j].upper = -VOTE_INFINITY;
+    }
+
+    size_t nb_node_hulls = 0;
+    vote_tree_span_node(t, i, hulls, &nb_node_hulls, slot, join);
+
+    if(nb_hulls + nb_node_hulls > capacity) {
+      capacity = 2 * (nb_hulls + nb_node_hulls);
+      t->hulls = realloc(t->hulls, capacity * sizeof(vote_hull_t));
+      assert(t->hulls);
+    }
+
+    memcpy(&t->hulls[nb_hulls], hulls, nb_node_hulls * sizeof(vote_hull_t));
+    qsort(&t->hulls[nb_hulls], nb_node_hulls, sizeof(vote_hull_t), vote_hull_cmp);
+    nb_hulls += nb_node_hulls;
+
+    for(size_t j=0; j<nb_node_hulls; j++) {
+      slot[hulls[j].feature] = SIZE_MAX;
+    }
+  }
+
+  t->spans[t->nb_nodes].hull = (uint32_t)nb_hulls;
+
+  free(hulls);
+  free(slot);
+}
+
+
+/**
+ * Find the outputs that the leaves of a tree contribute to. When all non-zero
+ * values of the tree belong to the same output, only that output is stored.
+ **/
+static void
+vote_tree_slice(vote_tree_t* t) {
+  bool single = t->nb_outputs > 1;
+  size_t output = SIZE_MAX;
+
+  for(size_t i=0; i<t->nb_nodes && single; i++) {
+    for(size_t j=0; j<t->nb_outputs; j++) {
+      if(t->value[i][j] == 0) {
+	continue;
+      }
+      if(output == SIZE_MAX) {
+	output = j;
+      } else if(output != j) {
+	single = false;
+      }
+    }
+  }
+
+  if(single) {
+    t->output = output == SIZE_MAX ? 0 : output;
+    t->nb_values = 1;
+  } else {
+    t->output = 0;
+    t->nb_values = t->nb_outputs;
+  }
+}
+
+
+void
+vote_tree_pack(vote_tree_t* t) {
+  free(t->nodes);
+  free(t->leaves);
+  
+  t->nodes = calloc(t->nb_nodes, sizeof(vote_node_t));
+  assert(t->nodes);
+
+  t->nb_leaves = 0;
+  for(size_t i=0; i<t->nb_nodes; i++) {
+    t->nb_leaves += (t->left[i] < 0 || t->right[i] < 0);
+  }
+  
+  vote_tree_slice(t);
+  
+  // leaf values are aligned to cache lines
+  size_t size = t->nb_leaves * t->nb_values * sizeof(real_t);
+  if(posix_memalign((void**)&t->leaves, VOTE_TREE_ALIGNMENT, size)) {
+    assert(false);
+  }
+  memset(t->leaves, 0, size);
+  
+  t->nb_leaves = 0;
+  vote_tree_pack_node(t, 0, 0, 1);
+
+  free(t->features);
+  
+  bool *tested = calloc(t->nb_inputs + 1, sizeof(bool));
+  assert(tested);
+  t->nb_features = 0;
+  
+  for(size_t i=0; i<t->nb_nodes; i++) {
+    const vote_node_t *n = &t->nodes[i];
+    if(!vote_node_is_leaf(n) && !tested[n->feature]) {
+      tested[n->feature] = true;
+      t->nb_features++;
+    }
+  }
+
+  t->features = calloc(t->nb_features + 1, sizeof(int));
+  assert(t->features);
+  
+  t->nb_features = 0;
+  for(size_t i=0; i<t->nb_inputs; i++) {
+    if(tested[i]) {
+      t->features[t->nb_features++] = (int)i;
+    }
+  }
+
+  free(tested);
+
+  vote_tree_span(t);
+
+  if(t->bitvector) {
+    vote_bitvector_del(t->bitvector);
+    t->bitvector = vote_bitvector_new(t);
+  }
+}
+
+
+const real_t*
+vote_tree_eval(const vote_tree_t *t, const real_t *inputs) {
+  const vote_node_t *n = t->nodes;
+
+  // the right child immediately succeeds the left one
+  while(!vote_node_is_leaf(n)) {
+    n = &t->nodes[n->child + (inputs[n->feature] > n->threshold)];
+  }
+
+  return vote_node_value(t, n);
+}
+
+
 /**
  * Parse a JSON dictionary into a tree.
  **/
@@ -103,47 +407,48 @@ vote_tree_t *
 vote_tree_parse(struct json_value_t *root) {
   struct json_object_t *obj;
   struct json_array_t *array;
-  size_t length;
+  vote_tree_t* tree;
+  size_t output = 0;
+  size_t nb_values;
   
-  vote_tree_t* tree = calloc(1, sizeof(vote_tree_t));
-  assert(tree);
-
   assert(json_value_get_type(root) == JSONObject);
   obj = json_value_get_object(root);
 
-  tree->nb_inputs = (size_t)json_object_get_number(obj, "nb_inputs");
-  tree->nb_outputs = (size_t)json_object_get_number(obj, "nb_outputs");
+  array = json_object_get_array(obj, "left");
+  tree = vote_tree_new(json_array_get_count(array),
+		       (size_t)json_object_get_number(obj, "nb_inputs"),
+		       (size_t)json_object_get_number(obj, "nb_outputs"));
   tree->normalize = json_object_get_boolean(obj, "normalize") > 0;
+  nb_values = tree->nb_outputs;
   
-  array = json_object_get_array(obj, "left");
-  vote_parse_ints(array, &tree->left, &length);
-  tree->nb_nodes = length;
+  vote_parse_ints(array, tree->left, tree->nb_nodes);
     
   array = json_object_get_array(obj, "right");
-  vote_parse_ints(array, &tree->right, &length);
-  assert(length == tree->nb_nodes);
+  vote_parse_ints(array, tree->right, tree->nb_nodes);
 
   array = json_object_get_array(obj, "feature");
-  vote_parse_ints(array, &tree->feature, &length);
-  assert(length == tree->nb_nodes);
+  vote_parse_ints(array, tree->feature, tree->nb_nodes);
 
   array = json_object_get_array(obj, "threshold");
-  vote_parse_floats(array, &tree->threshold, &length);
-  assert(length == tree->nb_nodes);
+  vote_parse_floats(array, tree->threshold, tree->nb_nodes);
 
-  array = json_object_get_array(obj, "value");
-  length = json_array_get_count(array);
-  assert(length == tree->nb_nodes);
+  // trees that contribute to a single output only list the values of it
+  if(json_object_has_value(obj, "output")) {
+    output = (size_t)json_object_get_number(obj, "output");
+    nb_values = 1;
+    assert(output < tree->nb_outputs);
+  }
   
-  tree->value = calloc(length, sizeof(real_t*));
-  assert(tree->value);
+  array = json_object_get_array(obj, "value");
+  assert(json_array_get_count(array) == tree->nb_nodes);
   
   for(size_t i=0; i<tree->nb_nodes; i++) {
     struct json_array_t *vec = json_array_get_array(array, i);
-    vote_parse_floats(vec, &tree->value[i], &length);
-    assert(length == tree->nb_outputs);
+    vote_parse_floats(vec, &tree->value[i][output], nb_values);
   }
 
+  vote_tree_pack(tree);
+  
   return tree;
 }
 
@@ -164,9 +469,14 @@ vote_tree_encode(const vote_tree_t* t) {
   json_object_set_value(obj, "feature", vote_encode_ints(t->feature, t->nb_nodes));
   json_object_set_value(obj, "threshold", vote_encode_reals(t->threshold, t->nb_nodes));
   json_object_set_value(obj, "value", value);
+
+  if(t->nb_values < t->nb_outputs) {
+    json_object_set_number(obj, "output", (double)t->output);
+  }
   
   for(size_t i=0; i<t->nb_nodes; i++) {
-    json_array_append_value(array, vote_encode_reals(t->value[i], t->nb_outputs));
+    json_array_append_value(array, vote_encode_reals(&t->value[i][t->output],
+						     t->nb_values));
   }
 
   return root;
@@ -175,8 +485,8 @@ vote_tree_encode(const vote_tree_t* t) {
 
 void
 vote_tree_del(vote_tree_t* t) {
-  for(size_t i=0; i<t->nb_nodes; i++) {
-    free(t->value[i]);
+  if(t->nb_nodes) {
+    free(t->value[0]);
   }
   
   free(t->left);
@@ -184,6 +494,16 @@ vote_tree_del(vote_tree_t* t) {
   free(t->feature);
   free(t->threshold);
   free(t->value);
+  free(t->nodes);
+  free(t->leaves);
+  free(t->features);
+  free(t->spans);
+  free(t->hulls);
+  free(t->joins);
+
+  if(t->bitvector) {
+    vote_bitvector_del(t->bitvector);
+  }
+  
   free(t);
 }
-
@@ -21,11 +21,65 @@ see <http://www.gnu.org/licenses/>.  */
 #define VOTE_TREE_H
 
 #include <stddef.h>
+#include <stdint.h>
+
+
+/**
+ * A packed node that fits in 16 bytes. Nodes are laid out in depth-first
+ * order, with the right child of a node immediately succeeding its left child.
+ * Leaves have a negative feature, and their child refers to a vector in the
+ * leaf value pool of the tree.
+ **/
+typedef struct vote_node {
+  real_t  threshold;
+  int32_t feature;
+  int32_t child;
+} vote_node_t;
+
+
+/**
+ * The smallest and largest threshold that some node below a particular node
+ * tests an input against. An input region contains a hull when its lower
+ * bound is at most the smallest threshold, and its upper bound exceeds the
+ * largest one.
+ **/
+typedef struct vote_hull {
+  real_t  lower;
+  real_t  upper;
+  int32_t feature;
+} vote_hull_t;
+
+
+/**
+ * Annotations of a packed node, i.e. where its threshold hulls and the join
+ * of the leaves below it are stored. The hulls of node i are those from
+ * spans[i].hull up to spans[i+1].hull, and leaves have none.
+ **/
+typedef struct vote_span {
+  uint32_t hull;
+  uint32_t join;
+} vote_span_t;
 
 
 /**
  * A Decision tree contains nodes with thresholds on input variables which 
  * determine the path traveled in the tree. Leaves carry values.
+ *
+ * The parallel arrays reflect the tree as it was loaded, whereas analyses
+ * operate on the packed nodes and leaf values derived from them. Packed leaf
+ * values are already normalized when the tree calls for it, and the features
+ * tested by the tree are listed in ascending order.
+ *
+ * When an input region contains the threshold hulls of an internal node, every
+ * leaf below that node is reachable, and the join of the node may be used in
+ * place of a descent into the subtree.
+ *
+ * Trees with a bitvector index find reachable leaves without descending.
+ *
+ * Leaves only store values for the nb_values outputs starting at output. That
+ * is all of them for most trees, but only one in trees of multi-class boosted
+ * ensembles, where each tree contributes to a single class. The outputs of
+ * joins are stored likewise.
  **/
 struct vote_tree {
   int* left;
@@ -35,9 +89,22 @@ struct vote_tree {
   real_t*  threshold;
   real_t** value;
 
+  vote_node_t* nodes;
+  real_t*      leaves;
+  int*         features;
+  vote_span_t*  spans;
+  vote_hull_t*  hulls;
+  vote_bound_t* joins;
+
+  struct vote_bitvector* bitvector;
+
   size_t nb_inputs;
   size_t nb_outputs;
+  size_t output;
+  size_t nb_values;
   size_t nb_nodes;
+  size_t nb_leaves;
+  size_t nb_features;
 
   bool normalize;
 };
@@ -58,6 +125,55 @@ vote_tree_t *vote_tree_parse(struct json_value_t *root);
 struct json_value_t *vote_tree_encode(const vote_tree_t* t);
 
 
+/**
+ * Allocate the parallel arrays of a tree with a given number of nodes.
+ **/
+vote_tree_t *vote_tree_new(size_t nb_nodes, size_t nb_inputs, size_t nb_outputs);
+
+
+/**
+ * Pack the nodes of a tree into a cache-friendly layout used by analyses.
+ **/
+void vote_tree_pack(vote_tree_t* t);
+
+
+/**
+ * Check if a packed node is a leaf.
+ **/
+#define vote_node_is_leaf(n) ((n)->feature < 0)
+
+
+/**
+ * Get the values of a packed leaf node.
+ **/
+#define vote_node_value(t, n) (&(t)->leaves[(size_t)(n)->child * (t)->nb_values])
+
+
+/**
+ * Get the threshold hulls of a packed internal node.
+ **/
+#define vote_node_hulls(t, id) (&(t)->hulls[(t)->spans[id].hull])
+
+
+/**
+ * Get the number of threshold hulls of a packed node.
+ **/
+#define vote_node_nb_hulls(t, id) ((t)->spans[(id) + 1].hull - (t)->spans[id].hull)
+
+
+/**
+ * Get the join of all leaves below a packed internal node.
+ **/
+#define vote_node_join(t, id) (&(t)->joins[(size_t)(t)->spans[id].join * (t)->nb_values])
+
+
+/**
+ * Get the values of the leaf that concrete inputs reach in a tree, i.e. the
+ * values of the nb_values outputs starting at output.
+ **/
+const real_t* vote_tree_eval(const vote_tree_t *t, const real_t *inputs);
+
+
 /**
  * Delete a tree and all of its members.
  **/
@@ -0,0 +1,479 @@
+/* Copyright (C) 2021 John Törnblom
+
+   This file is part of VoTE (Verifier of Tree Ensembles).
+
+VoTE is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+VoTE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or
+FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with VoTE; see the files COPYING and COPYING.LESSER. If not,
+see <http://www.gnu.org/licenses/>.  */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "vote.h"
+#include "vote_workpool.h"
+
+
+/**
+ * A forked piece of work.
+ **/
+typedef struct vote_task {
+  vote_task_cb_t *cb;
+  const void     *ctx;
+  size_t          node_id;
+  vote_mapping_t *mapping;
+} vote_task_t;
+
+
+/**
+ * A worker thread with a deque of tasks. The owner pushes and pops tasks at
+ * the tail (depth-first), while thieves steal from the head where the
+ * largest chunks of work reside.
+ **/
+typedef struct vote_worker {
+  vote_workpool_t *pool;
+  pthread_t        thread;
+  pthread_mutex_t  lock;
+  vote_task_t     *tasks;
+  size_t           head;
+  size_t           tail;
+  size_t           capacity;
+  size_t           id;
+  size_t           nb_tasks;
+} vote_worker_t;
+
+
+/**
+ * Workers are created together with the pool, and park on the wake condition
+ * between runs. A run bumps the generation of the pool to wake them, and waits
+ * on the finished condition until all of them have parked again.
+ **/
+struct vote_workpool {
+  vote_worker_t  *workers;
+  size_t          nb_workers;
+  pthread_key_t   key;
+  pthread_mutex_t lock;
+  pthread_cond_t  cond;
+  pthread_cond_t  wake;
+  pthread_cond_t  finished;
+  size_t          generation;
+  size_t          nb_running;
+  bool            quit;
+  size_t          nb_idle;
+  size_t          nb_pending;
+  bool            cancelled;
+  bool            done;
+  vote_range_cb_t *range_cb;
+  const void      *range_ctx;
+  size_t           range_next;
+  size_t           range_end;
+  size_t           range_chunk;
+};
+
+
+/**
+ * Push a task to the tail of the deque of a worker.
+ **/
+static void
+vote_worker_push(vote_worker_t *w, const vote_task_t *task) {
+  pthread_mutex_lock(&w->lock);
+
+  if(w->tail == w->capacity) {
+    if(w->head) {
+      memmove(w->tasks, &w->tasks[w->head],
+	      (w->tail - w->head) * sizeof(vote_task_t));
+      w->tail -= w->head;
+      w->head = 0;
+    } else {
+      w->capacity = w->capacity ? w->capacity * 2 : 64;
+      w->tasks = realloc(w->tasks, w->capacity * sizeof(vote_task_t));
+      assert(w->tasks);
+    }
+  }
+
+  w->tasks[w->tail++] = *task;
+  __atomic_add_fetch(&w->pool->nb_pending, 1, __ATOMIC_SEQ_CST);
+
+  pthread_mutex_unlock(&w->lock);
+}
+
+
+/**
+ * Pop a task from the tail (owner) or head (thief) of the deque of a worker.
+ **/
+static bool
+vote_worker_pop(vote_worker_t *w, vote_task_t *task, bool steal) {
+  bool found = false;
+
+  pthread_mutex_lock(&w->lock);
+
+  if(w->head < w->tail) {
+    if(steal) {
+      *task = w->tasks[w->head++];
+    } else {
+      *task = w->tasks[--w->tail];
+    }
+    if(w->head == w->tail) {
+      w->head = w->tail = 0;
+    }
+    __atomic_sub_fetch(&w->pool->nb_pending, 1, __ATOMIC_SEQ_CST);
+    found = true;
+  }
+
+  pthread_mutex_unlock(&w->lock);
+
+  return found;
+}
+
+
+/**
+ * Obtain a task, either from the deque of a worker, or from some other
+ * worker in the pool.
+ **/
+static bool
+vote_worker_next(vote_worker_t *w, vote_task_t *task) {
+  vote_workpool_t *pool = w->pool;
+
+  if(vote_worker_pop(w, task, false)) {
+    return true;
+  }
+
+  for(size_t i=1; i<pool->nb_workers; i++) {
+    vote_worker_t *victim = &pool->workers[(w->id + i) % pool->nb_workers];
+    if(vote_worker_pop(victim, task, true)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+/**
+ * Wait for more tasks to become available. Returns false when there are no
+ * more tasks to wait for, i.e. when all workers are idle.
+ **/
+static bool
+vote_worker_wait(vote_worker_t *w) {
+  vote_workpool_t *pool = w->pool;
+  bool done;
+
+  pthread_mutex_lock(&pool->lock);
+  __atomic_add_fetch(&pool->nb_idle, 1, __ATOMIC_SEQ_CST);
+
+  while(!pool->done &&
+	!__atomic_load_n(&pool->nb_pending, __ATOMIC_SEQ_CST)) {
+    if(__atomic_load_n(&pool->nb_idle, __ATOMIC_SEQ_CST) == pool->nb_workers) {
+      pool->done = true;
+      pthread_cond_broadcast(&pool->cond);
+      break;
+    }
+    pthread_cond_wait(&pool->cond, &pool->lock);
+  }
+
+  __atomic_sub_fetch(&pool->nb_idle, 1, __ATOMIC_SEQ_CST);
+  done = pool->done;
+  pthread_mutex_unlock(&pool->lock);
+
+  return !done;
+}
+
+
+/**
+ * Process tasks until the pool runs out of work.
+ **/
+static void
+vote_worker_tasks(vote_worker_t *w) {
+  vote_workpool_t *pool = w->pool;
+  vote_task_t task;
+
+  do {
+    while(vote_worker_next(w, &task)) {
+      if(!vote_workpool_cancelled(pool)) {
+	w->nb_tasks++;
+	if(!task.cb(task.ctx, task.node_id, task.mapping)) {
+	  vote_workpool_cancel(pool);
+	}
+      }
+      vote_mapping_del(task.mapping);
+    }
+  } while(vote_worker_wait(w));
+}
+
+
+/**
+ * Process chunks of a range until all of them have been claimed.
+ **/
+static void
+vote_worker_range(vote_worker_t *w) {
+  vote_workpool_t *pool = w->pool;
+  size_t begin, end;
+
+  while((begin = __atomic_fetch_add(&pool->range_next, pool->range_chunk,
+				    __ATOMIC_RELAXED)) < pool->range_end) {
+    end = begin + pool->range_chunk;
+    if(end > pool->range_end) {
+      end = pool->range_end;
+    }
+    w->nb_tasks++;
+    pool->range_cb(pool->range_ctx, begin, end);
+  }
+}
+
+
+/**
+ * Park until the next run of the pool, take part in it, and repeat until the
+ * pool is deleted.
+ **/
+static void*
+vote_worker_thread(void *ctx) {
+  vote_worker_t *w = (vote_worker_t*)ctx;
+  vote_workpool_t *pool = w->pool;
+  size_t generation = 0;
+  bool range;
+
+  pthread_setspecific(pool->key, w);
+  pthread_mutex_lock(&pool->lock);
+
+  while(true) {
+    while(!pool->quit && pool->generation == generation) {
+      pthread_cond_wait(&pool->wake, &pool->lock);
+    }
+    if(pool->quit) {
+      break;
+    }
+
+    generation = pool->generation;
+    range = pool->range_cb != NULL;
+    pthread_mutex_unlock(&pool->lock);
+
+    if(range) {
+      vote_worker_range(w);
+    } else {
+      vote_worker_tasks(w);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    if(!--pool->nb_running) {
+      pthread_cond_signal(&pool->finished);
+    }
+  }
+
+  pthread_mutex_unlock(&pool->lock);
+
+  return NULL;
+}
+
+
+/**
+ * Wake all workers for a new run, and block until all of them have finished
+ * their part of it.
+ **/
+static void
+vote_workpool_dispatch(vote_workpool_t *pool) {
+  pthread_mutex_lock(&pool->lock);
+
+  pool->nb_running = pool->nb_workers;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->wake);
+
+  while(pool->nb_running) {
+    pthread_cond_wait(&pool->finished, &pool->lock);
+  }
+
+  pthread_mutex_unlock(&pool->lock);
+}
+
+
+/**
+ * Stop and join the first nb_threads workers of a pool, and free the pool.
+ **/
+static void
+vote_workpool_free(vote_workpool_t *pool, size_t nb_threads) {
+  pthread_mutex_lock(&pool->lock);
+  pool->quit = true;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+
+  for(size_t i=0; i<nb_threads; i++) {
+    pthread_join(pool->workers[i].thread, NULL);
+  }
+
+  for(size_t i=0; i<pool->nb_workers; i++) {
+    pthread_mutex_destroy(&pool->workers[i].lock);
+    free(pool->workers[i].tasks);
+  }
+
+  pthread_key_delete(pool->key);
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->cond);
+  pthread_cond_destroy(&pool->wake);
+  pthread_cond_destroy(&pool->finished);
+
+  free(pool->workers);
+  free(pool);
+}
+
+
+vote_workpool_t*
+vote_workpool_new(size_t nb_threads) {
+  vote_workpool_t *pool = calloc(1, sizeof(vote_workpool_t));
+  assert(pool);
+
+  if(!nb_threads) {
+    long nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    nb_threads = nb_cpus > 0 ? (size_t)nb_cpus : 1;
+  }
+
+  pool->nb_workers = nb_threads;
+  pool->workers = calloc(nb_threads, sizeof(vote_worker_t));
+  assert(pool->workers);
+
+  for(size_t i=0; i<nb_threads; i++) {
+    pool->workers[i].pool = pool;
+    pool->workers[i].id = i;
+    pthread_mutex_init(&pool->workers[i].lock, NULL);
+  }
+
+  pthread_key_create(&pool->key, NULL);
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->cond, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+  pthread_cond_init(&pool->finished, NULL);
+
+  // runs wait for every worker, so a pool cannot do without any of them
+  for(size_t i=0; i<nb_threads; i++) {
+    if(pthread_create(&pool->workers[i].thread, NULL, vote_worker_thread,
+		      &pool->workers[i])) {
+      vote_workpool_free(pool, i);
+      return NULL;
+    }
+  }
+
+  return pool;
+}
+
+
+void
+vote_workpool_del(vote_workpool_t *pool) {
+  vote_workpool_free(pool, pool->nb_workers);
+}
+
+
+bool
+vote_workpool_run(vote_workpool_t *pool, vote_task_cb_t *cb,
+		  const void *ctx, size_t node_id, vote_mapping_t *m) {
+  vote_task_t task = {
+    .cb = cb,
+    .ctx = ctx,
+    .node_id = node_id,
+    .mapping = m
+  };
+
+  pool->done = false;
+  pool->cancelled = false;
+  pool->nb_idle = 0;
+  pool->range_cb = NULL;
+
+  for(size_t i=0; i<pool->nb_workers; i++) {
+    pool->workers[i].nb_tasks = 0;
+  }
+
+  vote_worker_push(&pool->workers[0], &task);
+  vote_workpool_dispatch(pool);
+
+  return !pool->cancelled;
+}
+
+
+void
+vote_workpool_range(vote_workpool_t *pool, vote_range_cb_t *cb,
+		    const void *ctx, size_t nb_items, size_t chunk_size) {
+  pool->range_cb = cb;
+  pool->range_ctx = ctx;
+  pool->range_next = 0;
+  pool->range_end = nb_items;
+  pool->range_chunk = chunk_size ? chunk_size : 1;
+
+  for(size_t i=0; i<pool->nb_workers; i++) {
+    pool->workers[i].nb_tasks = 0;
+  }
+
+  vote_workpool_dispatch(pool);
+}
+
+
+bool
+vote_workpool_hungry(const vote_workpool_t *pool) {
+  return __atomic_load_n(&pool->nb_idle, __ATOMIC_RELAXED) > 0;
+}
+
+
+void
+vote_workpool_fork(vote_workpool_t *pool, vote_task_cb_t *cb,
+		   const void *ctx, size_t node_id, vote_mapping_t *m) {
+  vote_worker_t *w = pthread_getspecific(pool->key);
+  vote_task_t task = {
+    .cb = cb,
+    .ctx = ctx,
+    .node_id = node_id,
+    .mapping = m
+  };
+
+  assert(w);
+  vote_worker_push(w, &task);
+
+  if(vote_workpool_hungry(pool)) {
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+  }
+}
+
+
+void
+vote_workpool_cancel(vote_workpool_t *pool) {
+  __atomic_store_n(&pool->cancelled, true, __ATOMIC_RELEASE);
+}
+
+
+bool
+vote_workpool_cancelled(const vote_workpool_t *pool) {
+  return __atomic_load_n(&pool->cancelled, __ATOMIC_ACQUIRE);
+}
+
+
+size_t
+vote_workpool_size(const vote_workpool_t *pool) {
+  return pool->nb_workers;
+}
+
+
+size_t
+vote_workpool_worker(const vote_workpool_t *pool) {
+  const vote_worker_t *w = pthread_getspecific(pool->key);
+
+  return w ? w->id : 0;
+}
+
+
+void
+vote_workpool_tasks(const vote_workpool_t *pool, size_t *nb_tasks) {
+  for(size_t i=0; i<pool->nb_workers; i++) {
+    nb_tasks[i] = pool->workers[i].nb_tasks;
+  }
+}
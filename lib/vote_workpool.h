@@ -0,0 +1,128 @@
+/* Copyright (C) 2021 John Törnblom
+
+   This file is part of VoTE (Verifier of Tree Ensembles).
+
+VoTE is free software: you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation, either version 3 of the License, or (at your option) any
+later version.
+
+VoTE is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or
+FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with VoTE; see the files COPYING and COPYING.LESSER. If not,
+see <http://www.gnu.org/licenses/>.  */
+
+#ifndef VOTE_WORKPOOL_H
+#define VOTE_WORKPOOL_H
+
+
+#include "vote.h"
+
+
+/**
+ * A pool of worker threads, each with its own deque of tasks. Idle workers
+ * steal tasks from the opposite end of the deques of busy workers.
+ **/
+typedef struct vote_workpool vote_workpool_t;
+
+
+/**
+ * Callback function prototype for a task, i.e. continue an analysis at
+ * a particular node with a mapping that is owned by the task.
+ **/
+typedef bool (vote_task_cb_t)(const void *ctx, size_t node_id, vote_mapping_t *m);
+
+
+/**
+ * Callback function prototype for a range of independent items [begin, end).
+ **/
+typedef void (vote_range_cb_t)(const void *ctx, size_t begin, size_t end);
+
+
+/**
+ * Create a new pool with a given number of worker threads. Zero threads
+ * means one thread per online processor. The threads are kept alive, parked
+ * between runs, until the pool is deleted.
+ *
+ * Returns NULL if the threads could not be created.
+ **/
+vote_workpool_t* vote_workpool_new(size_t nb_threads);
+
+
+/**
+ * Delete a pool and free associated resources.
+ **/
+void vote_workpool_del(vote_workpool_t *pool);
+
+
+/**
+ * Run a task on the pool and block until it, and all tasks forked from it,
+ * have completed or the pool has been cancelled. The pool takes ownership
+ * of the mapping.
+ *
+ * Returns false if any task failed.
+ **/
+bool vote_workpool_run(vote_workpool_t *pool, vote_task_cb_t *cb,
+		       const void *ctx, size_t node_id, vote_mapping_t *m);
+
+
+/**
+ * Process a range of independent items on the pool, and block until all of
+ * them have been processed. Workers repeatedly claim the next chunk of items
+ * that has yet to be processed.
+ **/
+void vote_workpool_range(vote_workpool_t *pool, vote_range_cb_t *cb,
+			 const void *ctx, size_t nb_items, size_t chunk_size);
+
+
+/**
+ * Check if there are idle workers in the pool, i.e. if the caller should
+ * consider forking some of its work.
+ **/
+bool vote_workpool_hungry(const vote_workpool_t *pool);
+
+
+/**
+ * Fork a task onto the deque of the calling worker. The pool takes ownership
+ * of the mapping.
+ **/
+void vote_workpool_fork(vote_workpool_t *pool, vote_task_cb_t *cb,
+			const void *ctx, size_t node_id, vote_mapping_t *m);
+
+
+/**
+ * Cancel all pending and running tasks in the pool.
+ **/
+void vote_workpool_cancel(vote_workpool_t *pool);
+
+
+/**
+ * Check if the pool has been cancelled.
+ **/
+bool vote_workpool_cancelled(const vote_workpool_t *pool);
+
+
+/**
+ * Get the number of workers in a pool.
+ **/
+size_t vote_workpool_size(const vote_workpool_t *pool);
+
+
+/**
+ * Get the index of the calling worker, or zero if the caller is not a worker
+ * of the pool.
+ **/
+size_t vote_workpool_worker(const vote_workpool_t *pool);
+
+
+/**
+ * Get the number of tasks each worker carried out during the last run.
+ **/
+void vote_workpool_tasks(const vote_workpool_t *pool, size_t *nb_tasks);
+
+
+#endif //VOTE_WORKPOOL_H
@@ -168,29 +168,11 @@ vote_xgboost_load(FILE* f) {
     read_size = fread(&tree_param, sizeof(tree_param), 1, f);
     assert(read_size == 1);
 
-    t = e->trees[i] = calloc(1, sizeof(vote_tree_t));
-    assert(t);
-
-    t->nb_inputs  = tree_param.num_feature;
-    t->nb_nodes   = tree_param.num_nodes;
-    t->nb_outputs = e->nb_outputs;
+    t = e->trees[i] = vote_tree_new(tree_param.num_nodes,
+				    tree_param.num_feature,
+				    e->nb_outputs);
 
     assert(t->nb_inputs == e->nb_inputs);
-
-    t->left = calloc(t->nb_nodes, sizeof(int));
-    assert(t->left);
-
-    t->right = calloc(t->nb_nodes, sizeof(int));
-    assert(t->right);
-
-    t->feature = calloc(t->nb_nodes, sizeof(int));
-    assert(t->feature);
-    
-    t->threshold = calloc(t->nb_nodes, sizeof(real_t));
-    assert(t->threshold);
-
-    t->value = calloc(t->nb_nodes, sizeof(real_t**));
-    assert(t->value);
     
     // Node
     for(int j=0; j<tree_param.num_nodes; j++) {
@@ -205,7 +187,6 @@ vote_xgboost_load(FILE* f) {
       t->right[j]     = node.cright;
       t->feature[j]   = -1;
       t->threshold[j] = 0;
-      t->value[j]     = calloc(t->nb_outputs, sizeof(real_t));
       
       // leaf node
       if(node.cleft == -1) {
@@ -230,6 +211,8 @@ vote_xgboost_load(FILE* f) {
       assert(read_size == 1);
     }
 
+    vote_tree_pack(t);
+
     e->nb_nodes += t->nb_nodes;
   }
 
@@ -0,0 +1,143 @@
+/* Copyright (C) 2021 John Törnblom
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <vote.h>
+
+
+/**
+ * Benchmark data for a backend.
+ **/
+typedef struct backend_analysis {
+  const char     *name;
+  vote_backend_t  backend;
+  real_t         *eval;
+  vote_bound_t   *approx;
+} backend_analysis_t;
+
+
+/**
+ * Evaluate and approximate each sample in a dataset using a particular
+ * backend, and print the time it took to stdout.
+ **/
+static void
+benchmark_backend(vote_ensemble_t *e, vote_dataset_t *ds, real_t margin,
+		  backend_analysis_t *a) {
+  vote_bound_t region[e->nb_inputs];
+  clock_t start;
+  
+  vote_ensemble_set_backend(e, a->backend);
+  
+  start = clock();
+  for(size_t row=0; row<ds->nb_rows; row++) {
+    real_t *sample = vote_dataset_row(ds, row);
+    vote_ensemble_eval(e, sample, &a->eval[row * e->nb_outputs]);
+  }
+  printf("backends:%s:eval:        %.2fus/sample\n", a->name,
+	 1e6 * (double)(clock() - start) / CLOCKS_PER_SEC / (double)ds->nb_rows);
+
+  start = clock();
+  for(size_t row=0; row<ds->nb_rows; row++) {
+    real_t *sample = vote_dataset_row(ds, row);
+    
+    for(size_t i=0; i<e->nb_inputs; i++) {
+      region[i].lower = sample[i] - margin;
+      region[i].upper = sample[i] + margin;
+    }
+    
+    vote_mapping_t *m = vote_ensemble_approximate(e, region);
+    memcpy(&a->approx[row * e->nb_outputs], m->outputs,
+	   e->nb_outputs * sizeof(vote_bound_t));
+    vote_mapping_del(m);
+  }
+  printf("backends:%s:approximate: %.2fus/sample\n", a->name,
+	 1e6 * (double)(clock() - start) / CLOCKS_PER_SEC / (double)ds->nb_rows);
+}
+
+
+/**
+ * Compare the backends for finding reachable leaves on a set of samples.
+ **/
+int main(int argc, char** argv) {
+  vote_ensemble_t* e;
+  vote_dataset_t* ds;
+  real_t margin = 0.1;
+  bool agree = true;
+  backend_analysis_t a[] = {
+    {.name = "descent",   .backend = VOTE_BACKEND_DESCENT},
+    {.name = "bitvector", .backend = VOTE_BACKEND_BITVECTOR}
+  };
+  const size_t nb_backends = sizeof(a) / sizeof(a[0]);
+  
+  if(argc < 3) {
+    printf("usage: %s <model file> <csv file> [margin]\n", argv[0]);
+    return 1;
+  }
+
+  if(argc > 3) {
+    margin = (real_t)atof(argv[3]);
+  }
+  
+  if(!(e = vote_ensemble_load_file(argv[1]))) {
+    printf("Unable to load model from %s\n", argv[1]);
+    exit(1);
+  }
+  
+  if(!(ds = vote_csv_load(argv[2]))) {
+    printf("Unable to load data from %s\n", argv[2]);
+    exit(1);
+  }
+  
+  if(ds->nb_cols < e->nb_inputs) {
+    printf("Unexpected number of columns in %s\n", argv[2]);
+    exit(1);
+  }
+
+  printf("backends:dataset:    %s\n", argv[2]);
+  printf("backends:nb_inputs:  %ld\n", e->nb_inputs);
+  printf("backends:nb_outputs: %ld\n", e->nb_outputs);
+  printf("backends:nb_trees:   %ld\n", e->nb_trees);
+  printf("backends:nb_nodes:   %ld\n", e->nb_nodes);
+  printf("backends:nb_samples: %ld\n", ds->nb_rows);
+  printf("backends:margin:     %g\n", margin);
+
+  for(size_t i=0; i<nb_backends; i++) {
+    a[i].eval = calloc(ds->nb_rows * e->nb_outputs, sizeof(real_t));
+    a[i].approx = calloc(ds->nb_rows * e->nb_outputs, sizeof(vote_bound_t));
+    
+    benchmark_backend(e, ds, margin, &a[i]);
+
+    agree &= !memcmp(a[0].eval, a[i].eval,
+		     ds->nb_rows * e->nb_outputs * sizeof(real_t));
+    agree &= !memcmp(a[0].approx, a[i].approx,
+		     ds->nb_rows * e->nb_outputs * sizeof(vote_bound_t));
+  }
+
+  printf("backends:agree:      %s\n", agree ? "yes" : "no");
+  
+  for(size_t i=0; i<nb_backends; i++) {
+    free(a[i].eval);
+    free(a[i].approx);
+  }
+  
+  vote_ensemble_del(e);
+  vote_dataset_del(ds);
+  
+  return !agree;
+}
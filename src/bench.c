@@ -0,0 +1,511 @@
+/* Copyright (C) 2021 John Törnblom
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vote.h>
+
+#include "synth.h"
+
+
+/**
+ * The maximum number of synthetic ensembles given on the command line.
+ **/
+#define BENCH_MAX_ENSEMBLES 32
+
+
+/**
+ * Settings shared by all benchmarks.
+ **/
+typedef struct bench_config {
+  size_t   repeat;
+  real_t   margin;
+  double   timeout;
+  uint64_t seed;
+  FILE    *out;
+  size_t   nb_results;
+} bench_config_t;
+
+
+/**
+ * The state of a workload on an ensemble, i.e. a plan for the workloads that
+ * enumerate mappings, and the number of mappings those have reached so far.
+ **/
+typedef struct bench_context {
+  const bench_config_t *config;
+  vote_ensemble_t      *ensemble;
+  vote_plan_t          *plan;
+  vote_bound_t         *region;
+  real_t               *outputs;
+  size_t                label;
+  size_t                nb_mappings;
+} bench_context_t;
+
+
+/**
+ * Run a workload on a single sample.
+ **/
+typedef vote_outcome_t (bench_run_t)(bench_context_t *c, const real_t *sample);
+
+
+/**
+ * A workload that is timed on one sample at a time.
+ **/
+typedef struct bench_workload {
+  const char      *name;
+  bench_run_t     *run;
+  vote_strategy_t  strategy;
+  bool             enumerates;
+} bench_workload_t;
+
+
+/**
+ * Count a mapping that passes.
+ **/
+static vote_outcome_t
+bench_count(void *ctx, vote_mapping_t *m) {
+  bench_context_t *c = (bench_context_t*)ctx;
+
+  VOTE_UNUSED(m);
+  c->nb_mappings++;
+
+  return VOTE_PASS;
+}
+
+
+/**
+ * Count a mapping, and check that it maps to the label of the sample.
+ **/
+static vote_outcome_t
+bench_check(void *ctx, vote_mapping_t *m) {
+  bench_context_t *c = (bench_context_t*)ctx;
+
+  c->nb_mappings++;
+
+  return vote_mapping_check_argmax(m, c->label);
+}
+
+
+/**
+ * Set the region to the neighbourhood of a sample.
+ **/
+static void
+bench_region(bench_context_t *c, const real_t *sample) {
+  for(size_t i=0; i<c->ensemble->nb_inputs; i++) {
+    c->region[i].lower = sample[i] - c->config->margin;
+    c->region[i].upper = sample[i] + c->config->margin;
+  }
+}
+
+
+/**
+ * Evaluate the ensemble on a sample.
+ **/
+static vote_outcome_t
+bench_eval(bench_context_t *c, const real_t *sample) {
+  vote_ensemble_eval(c->ensemble, sample, c->outputs);
+
+  return VOTE_PASS;
+}
+
+
+/**
+ * Approximate the outputs of the ensemble in the neighbourhood of a sample.
+ **/
+static vote_outcome_t
+bench_approximate(bench_context_t *c, const real_t *sample) {
+  vote_mapping_t *m;
+
+  bench_region(c, sample);
+  m = vote_ensemble_approximate(c->ensemble, c->region);
+  vote_mapping_del(m);
+
+  return VOTE_PASS;
+}
+
+
+/**
+ * Enumerate all precise mappings in the neighbourhood of a sample.
+ **/
+static vote_outcome_t
+bench_forall(bench_context_t *c, const real_t *sample) {
+  vote_limits_t limits = {.max_seconds = c->config->timeout};
+
+  bench_region(c, sample);
+
+  return vote_plan_run_limited(c->plan, c->region, bench_count, c, &limits);
+}
+
+
+/**
+ * Check that the neighbourhood of a sample maps to the label of the sample.
+ **/
+static vote_outcome_t
+bench_robust(bench_context_t *c, const real_t *sample) {
+  vote_limits_t limits = {.max_seconds = c->config->timeout};
+
+  vote_ensemble_eval(c->ensemble, sample, c->outputs);
+  c->label = 0;
+  for(size_t i=1; i<c->ensemble->nb_outputs; i++) {
+    if(c->outputs[i] > c->outputs[c->label]) {
+      c->label = i;
+    }
+  }
+
+  bench_region(c, sample);
+
+  return vote_plan_run_limited(c->plan, c->region, bench_check, c, &limits);
+}
+
+
+/**
+ * Order durations in ascending order.
+ **/
+static int
+bench_compare(const void *a, const void *b) {
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+
+  return (x > y) - (x < y);
+}
+
+
+/**
+ * Get a percentile of sorted durations, using the nearest rank.
+ **/
+static double
+bench_percentile(const double *sorted, size_t n, double q) {
+  size_t rank = (size_t)(q * (double)n + 0.999999);
+
+  return sorted[rank ? rank - 1 : 0];
+}
+
+
+/**
+ * Get the number of seconds elapsed since some point in time.
+ **/
+static double
+bench_elapsed(const struct timespec *start) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (double)(now.tv_sec - start->tv_sec) +
+    (double)(now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+
+/**
+ * Time a workload on an ensemble for each sample, and write the result as a
+ * JSON object. The first sample is run once before timing starts.
+ **/
+static void
+bench_workload(bench_config_t *cfg, vote_ensemble_t *e, const char *header,
+	       const bench_workload_t *w, real_t *const *samples) {
+  double *durations = calloc(cfg->repeat, sizeof(double));
+  vote_bound_t region[e->nb_inputs + 1];
+  real_t outputs[e->nb_outputs + 1];
+  bench_context_t c = {
+    .config = cfg,
+    .ensemble = e,
+    .region = region,
+    .outputs = outputs
+  };
+  size_t nb_exhausted = 0;
+  double total = 0;
+
+  assert(durations);
+  if(w->enumerates) {
+    c.plan = vote_plan_new(e, w->strategy, 1);
+  }
+
+  w->run(&c, samples[0]);
+  c.nb_mappings = 0;
+
+  for(size_t i=0; i<cfg->repeat; i++) {
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    nb_exhausted += w->run(&c, samples[i]) == VOTE_EXHAUSTED;
+    durations[i] = bench_elapsed(&start);
+    total += durations[i];
+  }
+
+  qsort(durations, cfg->repeat, sizeof(double), bench_compare);
+
+  fprintf(cfg->out, "%s\n    {%s, \"workload\": \"%s\", \"runs\": %zu, "
+	  "\"exhausted\": %zu, \"median_us\": %.3f, \"p99_us\": %.3f, "
+	  "\"mappings\": %zu, \"mappings_per_s\": %.1f}",
+	  cfg->nb_results++ ? "," : "", header, w->name, cfg->repeat,
+	  nb_exhausted, 1e6 * bench_percentile(durations, cfg->repeat, 0.5),
+	  1e6 * bench_percentile(durations, cfg->repeat, 0.99), c.nb_mappings,
+	  total > 0 ? (double)c.nb_mappings / total : 0);
+  fflush(cfg->out);
+
+  if(c.plan) {
+    vote_plan_del(c.plan);
+  }
+  free(durations);
+}
+
+
+/**
+ * Time all workloads on an ensemble.
+ **/
+static void
+bench_ensemble(bench_config_t *cfg, vote_ensemble_t *e, const char *header,
+	       real_t *const *samples) {
+  const bench_workload_t workloads[] = {
+    {.name = "eval",        .run = bench_eval},
+    {.name = "approximate", .run = bench_approximate},
+    {.name = "forall",      .run = bench_forall,
+     .strategy = VOTE_STRATEGY_REFINE, .enumerates = true},
+    {.name = "absref",      .run = bench_robust,
+     .strategy = VOTE_STRATEGY_ABSREF, .enumerates = true},
+    {.name = "robustness",  .run = bench_robust,
+     .strategy = VOTE_STRATEGY_CLASSWISE, .enumerates = true}
+  };
+
+  for(size_t i=0; i<sizeof(workloads) / sizeof(workloads[0]); i++) {
+    bench_workload(cfg, e, header, &workloads[i], samples);
+  }
+}
+
+
+/**
+ * Time all workloads on a synthetic ensemble, with samples drawn uniformly
+ * from the unit hypercube.
+ **/
+static void
+bench_synthetic(bench_config_t *cfg, synth_params_t *p) {
+  real_t *points = calloc(cfg->repeat * p->nb_inputs, sizeof(real_t));
+  real_t **samples = calloc(cfg->repeat, sizeof(real_t*));
+  vote_ensemble_t *e;
+  synth_rng_t rng;
+  char header[256];
+
+  assert(points);
+  assert(samples);
+
+  p->seed = cfg->seed;
+  e = synth_ensemble(p);
+
+  synth_seed(&rng, cfg->seed + 1);
+  for(size_t i=0; i<cfg->repeat; i++) {
+    samples[i] = &points[i * p->nb_inputs];
+    for(size_t j=0; j<p->nb_inputs; j++) {
+      samples[i][j] = synth_uniform(&rng);
+    }
+  }
+
+  snprintf(header, sizeof(header), "\"ensemble\": \"synthetic\", "
+	   "\"nb_trees\": %zu, \"depth\": %zu, \"nb_inputs\": %zu, "
+	   "\"nb_outputs\": %zu, \"nb_nodes\": %zu", e->nb_trees, p->depth,
+	   e->nb_inputs, e->nb_outputs, e->nb_nodes);
+
+  bench_ensemble(cfg, e, header, samples);
+  vote_ensemble_del(e);
+  free(samples);
+  free(points);
+}
+
+
+/**
+ * Time all workloads on an ensemble with the rows of a dataset as samples.
+ * Without a model, a random forest is synthesized with thresholds drawn
+ * from the dataset.
+ **/
+static void
+bench_dataset(bench_config_t *cfg, const char *model, const char *dataset) {
+  real_t **samples = calloc(cfg->repeat, sizeof(real_t*));
+  vote_ensemble_t *e;
+  vote_dataset_t *ds;
+  size_t nb_classes = 1;
+  char header[512];
+
+  assert(samples);
+  if(!(ds = vote_csv_load(dataset))) {
+    fprintf(stderr, "Unable to load data from %s\n", dataset);
+    exit(1);
+  }
+
+  // the label is in the last column
+  for(size_t row=0; row<ds->nb_rows; row++) {
+    real_t label = vote_dataset_row(ds, row)[ds->nb_cols - 1];
+    if(label >= (real_t)nb_classes) {
+      nb_classes = (size_t)label + 1;
+    }
+  }
+
+  if(model && !(e = vote_ensemble_load_file(model))) {
+    fprintf(stderr, "Unable to load model from %s\n", model);
+    exit(1);
+  } else if(!model) {
+    synth_params_t p = {
+      .nb_trees = 25,
+      .depth = 6,
+      .nb_inputs = ds->nb_cols - 1,
+      .nb_outputs = nb_classes,
+      .post_process = VOTE_POST_PROCESS_DIVISOR,
+      .seed = cfg->seed,
+      .data = ds
+    };
+    e = synth_ensemble(&p);
+  }
+
+  if(ds->nb_cols < e->nb_inputs) {
+    fprintf(stderr, "Unexpected number of columns in %s\n", dataset);
+    exit(1);
+  }
+
+  for(size_t i=0; i<cfg->repeat; i++) {
+    samples[i] = vote_dataset_row(ds, i % ds->nb_rows);
+  }
+
+  snprintf(header, sizeof(header), "\"ensemble\": \"%s\", "
+	   "\"dataset\": \"%s\", \"nb_trees\": %zu, \"nb_inputs\": %zu, "
+	   "\"nb_outputs\": %zu, \"nb_nodes\": %zu",
+	   model ? model : "synthetic", dataset, e->nb_trees, e->nb_inputs,
+	   e->nb_outputs, e->nb_nodes);
+
+  bench_ensemble(cfg, e, header, samples);
+  vote_ensemble_del(e);
+  vote_dataset_del(ds);
+  free(samples);
+}
+
+
+/**
+ * Parse the shape of a synthetic ensemble, i.e. TREES,DEPTH,INPUTS,OUTPUTS.
+ **/
+static bool
+parse_shape(const char *s, synth_params_t *p) {
+  unsigned long t, d, f, o;
+
+  if(sscanf(s, "%lu,%lu,%lu,%lu", &t, &d, &f, &o) != 4 || !t || !f || !o) {
+    return false;
+  }
+
+  p->nb_trees = t;
+  p->depth = d;
+  p->nb_inputs = f;
+  p->nb_outputs = o;
+
+  return true;
+}
+
+
+/**
+ * Print the command line usage to stdout.
+ **/
+static void
+usage(const char *program) {
+  printf("usage: %s [--repeat=N] [--margin=X] [--timeout=SECONDS] "
+	 "[--seed=N] [--ensemble=TREES,DEPTH,INPUTS,OUTPUTS]... "
+	 "[--model=FILE] [--output=FILE] [<csv file>]\n", program);
+}
+
+
+/**
+ * Run the workloads on synthetic ensembles, and on a dataset if given, and
+ * write the timings as JSON.
+ **/
+int main(int argc, char** argv) {
+  synth_params_t shapes[BENCH_MAX_ENSEMBLES] = {
+    {.nb_trees = 10,  .depth = 4, .nb_inputs = 8,  .nb_outputs = 2},
+    {.nb_trees = 25,  .depth = 6, .nb_inputs = 16, .nb_outputs = 2},
+    {.nb_trees = 100, .depth = 4, .nb_inputs = 16, .nb_outputs = 4},
+    {.nb_trees = 50,  .depth = 8, .nb_inputs = 32, .nb_outputs = 3}
+  };
+  size_t nb_shapes = 4;
+  bool custom = false;
+  const char *model = NULL;
+  const char *output = NULL;
+  bench_config_t cfg = {
+    .repeat = 100,
+    .margin = 0.05,
+    .timeout = 0.1,
+    .seed = 1,
+    .out = stdout
+  };
+
+  while(argc > 1 && !strncmp(argv[1], "--", 2)) {
+    if(!strncmp(argv[1], "--repeat=", 9)) {
+      cfg.repeat = (size_t)atol(argv[1] + 9);
+    } else if(!strncmp(argv[1], "--margin=", 9)) {
+      cfg.margin = (real_t)atof(argv[1] + 9);
+    } else if(!strncmp(argv[1], "--timeout=", 10)) {
+      cfg.timeout = atof(argv[1] + 10);
+    } else if(!strncmp(argv[1], "--seed=", 7)) {
+      cfg.seed = (uint64_t)strtoull(argv[1] + 7, NULL, 10);
+    } else if(!strncmp(argv[1], "--ensemble=", 11)) {
+      if(!custom) {
+	custom = true;
+	nb_shapes = 0;
+      }
+      if(nb_shapes == BENCH_MAX_ENSEMBLES ||
+	 !parse_shape(argv[1] + 11, &shapes[nb_shapes++])) {
+	printf("Invalid ensemble %s\n", argv[1] + 11);
+	return 1;
+      }
+    } else if(!strncmp(argv[1], "--model=", 8)) {
+      model = argv[1] + 8;
+    } else if(!strncmp(argv[1], "--output=", 9)) {
+      output = argv[1] + 9;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+    argv[1] = argv[0];
+    argv++;
+    argc--;
+  }
+
+  if(!cfg.repeat || (model && argc < 2)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if(output && !(cfg.out = fopen(output, "w"))) {
+    printf("Unable to open %s\n", output);
+    return 1;
+  }
+
+  fprintf(cfg.out, "{\n  \"seed\": %llu,\n  \"repeat\": %zu,\n"
+	  "  \"margin\": %g,\n  \"timeout\": %g,\n  \"results\": [",
+	  (unsigned long long)cfg.seed, cfg.repeat, cfg.margin, cfg.timeout);
+
+  for(size_t i=0; i<nb_shapes; i++) {
+    bench_synthetic(&cfg, &shapes[i]);
+  }
+
+  if(argc > 1) {
+    bench_dataset(&cfg, model, argv[1]);
+  }
+
+  fprintf(cfg.out, "\n  ]\n}\n");
+
+  if(output) {
+    fclose(cfg.out);
+  }
+
+  return 0;
+}
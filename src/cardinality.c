@@ -16,11 +16,15 @@ along with this program; see the file COPYING. If not, see
 
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stddef.h>
 #include <assert.h>
 #include <math.h>
+#include <string.h>
 #include <vote.h>
 
+#include "stats.h"
+
 
 /**
  * Count number of precise mappings.
@@ -31,7 +35,7 @@ count_mapping(void *ctx, vote_mapping_t *m) {
 
   assert(vote_mapping_precise(m));
   
-  (*nb_mappings)++;
+  __atomic_add_fetch(nb_mappings, 1, __ATOMIC_RELAXED);
   
   return VOTE_PASS;
 }
@@ -41,15 +45,38 @@ count_mapping(void *ctx, vote_mapping_t *m) {
  * Print the number of mappings of an ensemble to stdout.
  **/
 int main(int argc, char** argv) {
+  const char *trace = NULL;
+  bool stats = false;
+
+  // optionally print statistics collected during the enumeration, and dump
+  // the latency of pipeline stages to a file
+  while(argc > 1 && !strncmp(argv[1], "--", 2)) {
+    if(!strcmp(argv[1], "--stats")) {
+      stats = true;
+    } else if(!strncmp(argv[1], "--trace=", 8)) {
+      trace = argv[1] + 8;
+    } else {
+      printf("Unknown option %s\n", argv[1]);
+      return 1;
+    }
+    argv[1] = argv[0];
+    argv++;
+    argc--;
+  }
+
   if(argc < 2) {
-    printf("usage: %s <model file>\n", argv[0]);
+    printf("usage: %s [--stats] [--trace=FILE] <model file> [nb_threads]\n", argv[0]);
     return 1;
   }
 
+  size_t nb_threads = argc > 2 ? (size_t)atoi(argv[2]) : 1;
   size_t nb_mappings = 0;
   vote_ensemble_t* e = vote_ensemble_load_file(argv[1]);
   assert(e);
 
+  vote_plan_t *p = vote_plan_new(e, VOTE_STRATEGY_REFINE, nb_threads);
+  vote_stats_t *s = vote_stats_new(e);
+
   printf("cardinality:filename:    %s\n", argv[1]);
   printf("cardinality:nb_inputs:   %ld\n", e->nb_inputs);
   printf("cardinality:nb_outputs:  %ld\n", e->nb_outputs);
@@ -62,10 +89,21 @@ int main(int argc, char** argv) {
     domain[i].upper = VOTE_INFINITY;
   }
   
-  vote_ensemble_forall(e, domain, count_mapping, &nb_mappings);
-  vote_ensemble_del(e);
+  vote_plan_set_stats(p, stats);
+  vote_plan_run(p, domain, count_mapping, &nb_mappings);
+  vote_plan_stats(p, s);
 
   printf("cardinality:nb_mappings: %ld\n", nb_mappings);
+  if(stats) {
+    stats_print("cardinality", s);
+  }
+  if(trace) {
+    trace_dump(trace);
+  }
+
+  vote_stats_del(s);
+  vote_plan_del(p);
+  vote_ensemble_del(e);
 
   return 0;
 }
@@ -16,18 +16,62 @@ along with this program; see the file COPYING. If not, see
 
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stddef.h>
 #include <assert.h>
 #include <math.h>
 #include <vote.h>
 
 
+/**
+ * Parse a budget for the refinement of the input/output space, i.e. a number
+ * of regions, or a number of seconds when suffixed with an s.
+ **/
+static bool
+parse_budget(const char *str, size_t *max_nodes, double *max_seconds) {
+  char *end;
+  double value = strtod(str, &end);
+
+  if(end == str || value < 0) {
+    return false;
+  }
+
+  if(!strcmp(end, "s")) {
+    *max_seconds = value;
+  } else if(!*end) {
+    *max_nodes = (size_t)value;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+
 /**
  * Print the input/output space of an ensemble to stdout.
  **/
 int main(int argc, char** argv) {
+  size_t max_nodes = 0;
+  double max_seconds = 0;
+  bool anytime = false;
+
+  // optional budget for tightening the output bounds by refinement
+  if(argc > 1 && !strncmp(argv[1], "--budget=", 9)) {
+    if(!parse_budget(argv[1] + 9, &max_nodes, &max_seconds)) {
+      printf("Invalid budget %s\n", argv[1] + 9);
+      return 1;
+    }
+    anytime = true;
+    argv[1] = argv[0];
+    argv++;
+    argc--;
+  }
+
   if(argc < 2) {
-    printf("usage: %s <model file>\n", argv[0]);
+    printf("usage: %s [--budget=<regions>|<seconds>s] <model file>\n",
+	   argv[0]);
     return 1;
   }
 
@@ -39,7 +83,13 @@ int main(int argc, char** argv) {
     domain[i].upper = VOTE_INFINITY;
   }
 
-  vote_mapping_t *m = vote_ensemble_approximate(e, domain);
+  vote_mapping_t *m;
+
+  if(anytime) {
+    m = vote_ensemble_approximate_anytime(e, domain, max_nodes, max_seconds);
+  } else {
+    m = vote_ensemble_approximate(e, domain);
+  }
   assert(m);
   
   for(size_t i=0; i<m->nb_inputs; i++) {
@@ -18,11 +18,14 @@ along with this program; see the file COPYING. If not, see
 #include <stdlib.h>
 #include <stdio.h>
 #include <stddef.h>
+#include <string.h>
 #include <math.h>
 #include <assert.h>
 #include <time.h>
 #include <vote.h>
 
+#include "stats.h"
+
 
 /**
  * Print a mapping to stdout.
@@ -44,6 +47,21 @@ dump_mapping(vote_mapping_t *m) {
 }
 
 
+/**
+ * Print an input region to stdout.
+ */
+static void
+dump_region(const vote_bound_t *region, size_t nb_inputs) {
+  for(size_t i=0; i<nb_inputs; i++) {
+    if(i) {
+      printf("\n                       ");
+    }
+    printf("x%ld in [%f, %f]", i, region[i].lower, region[i].upper);
+  }
+  printf("\n");
+}
+
+
 /**
  * Check if there are points in the ouput that fall
  * outside a given range.
@@ -72,16 +90,97 @@ is_within_range(void *ctx, vote_mapping_t *m) {
 }
  
 
+/**
+ * Parse the name of a heuristic that orders the refinement of trees.
+ **/
+static bool
+parse_order(const char *name, vote_order_t *order) {
+  if(!strcmp(name, "file")) {
+    *order = VOTE_ORDER_FILE;
+  } else if(!strcmp(name, "leaves")) {
+    *order = VOTE_ORDER_LEAVES;
+  } else if(!strcmp(name, "width")) {
+    *order = VOTE_ORDER_WIDTH;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+
+/**
+ * Compute the smallest and largest value of each output, and print them
+ * together with the input regions where they are attained.
+ **/
+static bool
+compute_range(vote_ensemble_t *e) {
+  vote_bound_t domain[e->nb_inputs];
+  vote_bound_t witness[e->nb_inputs];
+  time_t t = time(NULL);
+  bool b = true;
+
+  for(size_t i=0; i<e->nb_inputs; i++) {
+    domain[i].lower = -VOTE_INFINITY;
+    domain[i].upper = VOTE_INFINITY;
+  }
+
+  for(size_t i=0; i<e->nb_outputs; i++) {
+    real_t lower, upper;
+
+    b &= vote_ensemble_minimize(e, domain, i, &lower, witness);
+    printf("range:y%ld:min:         %f\n", i, lower);
+    printf("range:y%ld:argmin:      ", i);
+    dump_region(witness, e->nb_inputs);
+
+    b &= vote_ensemble_maximize(e, domain, i, &upper, witness);
+    printf("range:y%ld:max:         %f\n", i, upper);
+    printf("range:y%ld:argmax:      ", i);
+    dump_region(witness, e->nb_inputs);
+  }
+
+  printf("range:runtime:         %lds\n", time(NULL) - t);
+
+  return b;
+}
+
+
 /**
  * Check the plausibility of range property.
  **/
 int main(int argc, char** argv) {
+  vote_order_t order = VOTE_ORDER_FILE;
   vote_ensemble_t* e;
+  const char *trace = NULL;
+  bool stats = false;
   bool b;
+
+  // optional heuristic that orders the refinement of trees, statistics
+  // collected while checking the requirement, and a dump of the latency of
+  // pipeline stages
+  while(argc > 1 && !strncmp(argv[1], "--", 2)) {
+    if(!strncmp(argv[1], "--order=", 8)) {
+      if(!parse_order(argv[1] + 8, &order)) {
+	printf("Unknown order %s\n", argv[1] + 8);
+	return 1;
+      }
+    } else if(!strcmp(argv[1], "--stats")) {
+      stats = true;
+    } else if(!strncmp(argv[1], "--trace=", 8)) {
+      trace = argv[1] + 8;
+    } else {
+      printf("Unknown option %s\n", argv[1]);
+      return 1;
+    }
+    argv[1] = argv[0];
+    argv++;
+    argc--;
+  }
   
   if(argc < 2) {
-    printf("usage: %s <model file> <min y0> <max y0> <min y1> <max y1>...\n",
-	   argv[0]);
+    printf("usage: %s [--order=file|leaves|width] [--stats] [--trace=FILE] "
+	   "<model file> "
+	   "[<min y0> <max y0> <min y1> <max y1>...]\n", argv[0]);
     return 1;
   }
 
@@ -90,6 +189,15 @@ int main(int argc, char** argv) {
     exit(1);
   }
 
+  vote_ensemble_set_order(e, order);
+
+  // without a requirement, compute the exact range of each output instead
+  if(argc == 2) {
+    b = compute_range(e);
+    vote_ensemble_del(e);
+    return !b;
+  }
+  
   if(argc < (e->nb_outputs * 2) + 2) {
     printf("Expected %ld min/max arguments, got %d\n", e->nb_outputs * 2, argc - 2);
     exit(1);
@@ -126,11 +234,25 @@ int main(int argc, char** argv) {
   printf("\n");
 
   
-  b = vote_ensemble_absref(e, domain, is_within_range, range);
-  vote_ensemble_del(e);
+  vote_plan_t *p = vote_plan_new(e, VOTE_STRATEGY_ABSREF, 1);
+  vote_stats_t *s = vote_stats_new(e);
+
+  vote_plan_set_stats(p, stats);
+  b = vote_plan_run(p, domain, is_within_range, range);
+  vote_plan_stats(p, s);
 
   printf("range:result:          %s\n", b ? "pass" : "fail");
   printf("range:runtime:         %lds\n", time(NULL) - t);
+  if(stats) {
+    stats_print("range", s);
+  }
+  if(trace) {
+    trace_dump(trace);
+  }
+
+  vote_stats_del(s);
+  vote_plan_del(p);
+  vote_ensemble_del(e);
   
   return !b;
 }
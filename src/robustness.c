@@ -25,9 +25,24 @@ along with this program; see the file COPYING. If not, see
 #include <time.h>
 #include <unistd.h>
 #include <limits.h>
+#include <pthread.h>
 #include <vote.h>
 
 #include "workqueue.h"
+#include "stats.h"
+
+
+/**
+ * Plans that are not in use by any thread, shared among sample analyses.
+ **/
+typedef struct plan_cache {
+  vote_ensemble_t *ensemble;
+  size_t           threads;
+  bool             stats;
+  vote_plan_t    **plans;
+  size_t           nb_plans;
+  pthread_mutex_t  lock;
+} plan_cache_t;
 
 
 /**
@@ -35,10 +50,15 @@ along with this program; see the file COPYING. If not, see
  **/
 typedef struct sample_analysis {
   vote_ensemble_t *ensemble;
+  plan_cache_t    *plans;
+  vote_plan_t     *plan;
   real_t           margin;
   real_t           timeout;
   real_t          *sample;
   size_t           label;
+  size_t           threads;
+  size_t          *tasks;
+  size_t          *run_tasks;
 
   struct timespec start_clock;
   struct timespec stop_clock;
@@ -55,6 +75,11 @@ typedef struct robustness_analysis {
   real_t           sample_timeout;
   real_t           margin;
   size_t           threads;
+  size_t           sample_threads;
+  vote_domain_t    domain;
+  vote_order_t     order;
+  bool             stats;
+  const char      *trace;
   vote_dataset_t  *dataset;
 } robustness_analysis_t;
 
@@ -80,23 +105,76 @@ timespec_diff(struct timespec *start, struct timespec *stop) {
 
 
 /**
- * Check that a mapping maps to a specific label.
+ * Check that a mapping maps to a specific label. When samples are analyzed
+ * on several threads, this function is invoked concurrently.
  **/
 static vote_outcome_t
 is_correct(void *ctx, vote_mapping_t *m) {
-  struct timespec curr_clock;
   sample_analysis_t *a = (sample_analysis_t*)ctx;
-  
-  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &curr_clock);
-  
-  if(timespec_diff(&a->start_clock, &curr_clock) > a->timeout) {
-    a->outcome = VOTE_UNSURE;
-    return VOTE_FAIL;
+
+  return vote_mapping_check_argmax(m, a->label);
+}
+
+
+/**
+ * Take a plan from the cache, or create a new one if all plans are in use.
+ **/
+static vote_plan_t*
+plan_acquire(plan_cache_t *c) {
+  vote_plan_t *p = NULL;
+
+  pthread_mutex_lock(&c->lock);
+  if(c->nb_plans) {
+    p = c->plans[--c->nb_plans];
+  }
+  pthread_mutex_unlock(&c->lock);
+
+  if(!p) {
+    p = vote_plan_new(c->ensemble, VOTE_STRATEGY_CLASSWISE, c->threads);
+    vote_plan_set_stats(p, c->stats);
   }
 
-  a->outcome = vote_mapping_check_argmax(m, a->label);
+  return p;
+}
+
 
-  return a->outcome;
+/**
+ * Return a plan to the cache.
+ **/
+static void
+plan_release(plan_cache_t *c, vote_plan_t *p) {
+  pthread_mutex_lock(&c->lock);
+  c->plans[c->nb_plans++] = p;
+  pthread_mutex_unlock(&c->lock);
+}
+
+
+/**
+ * Iterate abstract mappings for a region around a sample, possibly with
+ * several threads, within the time that remains for the sample.
+ **/
+static vote_outcome_t
+analyze_region(sample_analysis_t *a, const vote_bound_t *bounds) {
+  struct timespec curr_clock;
+  vote_limits_t limits = {0};
+  vote_outcome_t res;
+
+  clock_gettime(CLOCK_MONOTONIC, &curr_clock);
+  limits.max_seconds = a->timeout - timespec_diff(&a->start_clock, &curr_clock);
+  if(limits.max_seconds <= 0) {
+    return VOTE_EXHAUSTED;
+  }
+
+  res = vote_plan_run_limited(a->plan, bounds, is_correct, a, &limits);
+
+  if(a->threads > 1) {
+    vote_plan_tasks(a->plan, a->run_tasks);
+    for(size_t i=0; i<a->threads; i++) {
+      a->tasks[i] += a->run_tasks[i];
+    }
+  }
+
+  return res;
 }
 
 
@@ -107,8 +185,16 @@ static void
 analyze_sample(void* ctx) {
   sample_analysis_t *a = (sample_analysis_t*)ctx;
   vote_bound_t bounds[a->ensemble->nb_inputs];
+  vote_outcome_t res;
+
+  clock_gettime(CLOCK_MONOTONIC, &a->start_clock);
+  a->plan = plan_acquire(a->plans);
 
-  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &a->start_clock);
+  // the tasks of the last run of the plan, before they are added up
+  if(a->threads > 1) {
+    a->run_tasks = calloc(a->threads, sizeof(size_t));
+    assert(a->run_tasks);
+  }
   
   for(size_t i=0; i<a->ensemble->nb_inputs; i++) {
     bounds[i].lower = a->sample[i];
@@ -116,15 +202,20 @@ analyze_sample(void* ctx) {
   }
 
   // don't bother with samples that are classified incorrectly
-  if(vote_ensemble_absref(a->ensemble, bounds, is_correct, a)) {
+  if((res = analyze_region(a, bounds)) == VOTE_PASS) {
     for(size_t i=0; i<a->ensemble->nb_inputs; i++) {
       bounds[i].lower -= a->margin;
       bounds[i].upper += a->margin;
     }
-    vote_ensemble_absref(a->ensemble, bounds, is_correct, a);
+    res = analyze_region(a, bounds);
   }
 
-  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &a->stop_clock);
+  plan_release(a->plans, a->plan);
+  free(a->run_tasks);
+  a->run_tasks = NULL;
+
+  a->outcome = res;
+  clock_gettime(CLOCK_MONOTONIC, &a->stop_clock);
 }
 
 
@@ -134,15 +225,35 @@ analyze_sample(void* ctx) {
 static void
 analyze_robustness(robustness_analysis_t *a) {
   size_t nb_samples = a->dataset->nb_rows;
-  sample_analysis_t analyses[nb_samples];
+  sample_analysis_t *analyses = calloc(nb_samples, sizeof(sample_analysis_t));
+  size_t *tasks = calloc(nb_samples * a->sample_threads, sizeof(size_t));
   workqueue_t *wq = workqueue_new();
+  vote_plan_t **plans = calloc(a->threads, sizeof(vote_plan_t*));
+  plan_cache_t cache = {
+    .ensemble = a->ensemble,
+    .threads = a->sample_threads,
+    .stats = a->stats,
+    .plans = plans,
+    .nb_plans = 0
+  };
   struct timespec start_clock;
   struct timespec stop_clock;
+  vote_stats_t *stats;
+
+  assert(analyses);
+  assert(tasks);
+  assert(plans);
+
+  vote_ensemble_set_domain(a->ensemble, a->domain);
+  vote_ensemble_set_order(a->ensemble, a->order);
   
   for(size_t row=0; row<nb_samples; row++) {
     analyses[row].ensemble = a->ensemble;
+    analyses[row].plans = &cache;
     analyses[row].margin = a->margin;
     analyses[row].timeout = a->sample_timeout;
+    analyses[row].threads = a->sample_threads;
+    analyses[row].tasks = &tasks[row * a->sample_threads];
     
     analyses[row].sample = vote_dataset_row(a->dataset, row);
     analyses[row].label = (size_t)roundf(analyses[row].sample[a->ensemble->nb_inputs]);
@@ -150,28 +261,36 @@ analyze_robustness(robustness_analysis_t *a) {
     workqueue_schedule(wq, analyze_sample, &analyses[row]);
   }
 
+  pthread_mutex_init(&cache.lock, NULL);
   clock_gettime(CLOCK_REALTIME, &start_clock);
   workqueue_launch(wq, a->threads);
   clock_gettime(CLOCK_REALTIME, &stop_clock);
 
+  stats = vote_stats_new(a->ensemble);
+  for(size_t i=0; i<cache.nb_plans; i++) {
+    vote_plan_stats(cache.plans[i], stats);
+    vote_plan_del(cache.plans[i]);
+  }
+  pthread_mutex_destroy(&cache.lock);
+
   real_t walltime = timespec_diff(&start_clock, &stop_clock);
   size_t passed = 0;
   size_t timeouts = 0;
   
   for(size_t row=0; row<nb_samples; row++) {
     passed += analyses[row].outcome == VOTE_PASS;
-    timeouts += analyses[row].outcome == VOTE_UNSURE;
+    timeouts += analyses[row].outcome == VOTE_EXHAUSTED;
   }
   
   printf("robustness:dataset:    %s\n", a->dataset->filename);
   printf("robustness:margin:     %g\n", a->margin);
   printf("robustness:timeout:    %gs\n", a->sample_timeout);
-  printf("robustness:nb_inputs:  %ld\n", a->ensemble->nb_inputs);
-  printf("robustness:nb_outputs: %ld\n", a->ensemble->nb_outputs);
-  printf("robustness:nb_trees:   %ld\n", a->ensemble->nb_trees);
-  printf("robustness:nb_nodes:   %ld\n", a->ensemble->nb_nodes);
-  printf("robustness:passed:     %ld\n", passed);
-  printf("robustness:timeouts:   %ld\n", timeouts);
+  printf("robustness:nb_inputs:  %zu\n", a->ensemble->nb_inputs);
+  printf("robustness:nb_outputs: %zu\n", a->ensemble->nb_outputs);
+  printf("robustness:nb_trees:   %zu\n", a->ensemble->nb_trees);
+  printf("robustness:nb_nodes:   %zu\n", a->ensemble->nb_nodes);
+  printf("robustness:passed:     %zu\n", passed);
+  printf("robustness:timeouts:   %zu\n", timeouts);
 
   if(timeouts) {
     printf("robustness:score:      [%g,%g]\n", (real_t)passed / nb_samples,
@@ -181,7 +300,30 @@ analyze_robustness(robustness_analysis_t *a) {
   }
   printf("robustness:runtime:    %gs\n", walltime);
 
+  if(a->sample_threads > 1) {
+    printf("robustness:tasks:      ");
+    for(size_t i=0; i<a->sample_threads; i++) {
+      size_t sum = 0;
+      for(size_t row=0; row<nb_samples; row++) {
+	sum += tasks[row * a->sample_threads + i];
+      }
+      printf("%s%zu", i ? " " : "", sum);
+    }
+    printf("\n");
+  }
+
+  if(a->stats) {
+    stats_print("robustness", stats);
+  }
+  if(a->trace) {
+    trace_dump(a->trace);
+  }
+
+  vote_stats_del(stats);
   workqueue_del(wq);
+  free(analyses);
+  free(tasks);
+  free(plans);
 }
 
 
@@ -198,6 +340,8 @@ parse_cb(int key, char *arg, struct argp_state *state) {
       fprintf(stderr, "Unable to load model from %s\n", arg);
       return ARGP_ERR_UNKNOWN;
     }
+    // samples are only checked on their argmax, no need for probabilities
+    vote_ensemble_set_postproc_mode(a->ensemble, VOTE_POSTPROC_LAZY);
     break;
 
   case 'M': //margin
@@ -211,6 +355,42 @@ parse_cb(int key, char *arg, struct argp_state *state) {
   case 't': //threads
     a->threads = atoi(arg);
     break;
+
+  case 's': //sample threads
+    a->sample_threads = atoi(arg);
+    break;
+
+  case 'd': //domain
+    if(!strcmp(arg, "interval")) {
+      a->domain = VOTE_DOMAIN_INTERVAL;
+    } else if(!strcmp(arg, "difference")) {
+      a->domain = VOTE_DOMAIN_DIFFERENCE;
+    } else {
+      fprintf(stderr, "Unknown domain %s\n", arg);
+      return ARGP_ERR_UNKNOWN;
+    }
+    break;
+
+  case 'o': //order
+    if(!strcmp(arg, "file")) {
+      a->order = VOTE_ORDER_FILE;
+    } else if(!strcmp(arg, "leaves")) {
+      a->order = VOTE_ORDER_LEAVES;
+    } else if(!strcmp(arg, "width")) {
+      a->order = VOTE_ORDER_WIDTH;
+    } else {
+      fprintf(stderr, "Unknown order %s\n", arg);
+      return ARGP_ERR_UNKNOWN;
+    }
+    break;
+
+  case 'S': //stats
+    a->stats = true;
+    break;
+
+  case 'r': //trace
+    a->trace = arg;
+    break;
     
   case ARGP_KEY_ARG: //CSV_FILE
     if(!(a->dataset = vote_csv_load(arg))) {
@@ -247,10 +427,28 @@ main(int argc, char** argv) {
 
     {.name="threads", .key='t', .arg="NUMBER",
      .doc="Perform analyses concurrently on a given NUMBER of threads"},
+
+    {.name="sample-threads", .key='s', .arg="NUMBER",
+     .doc="Split the analysis of each sample across a given NUMBER of threads"},
     
     {.name="timeout", .key='T', .arg="NUMBER",
      .doc="Timeout the analysis of a sample after NUMBER seconds"},
 
+    {.name="domain", .key='d', .arg="NAME",
+     .doc="Bound outputs with intervals (default), or also bound the "
+          "difference between the leading output and every output"},
+
+    {.name="order", .key='o', .arg="NAME",
+     .doc="Refine trees in file order (default), by ascending number of "
+          "reachable leaves, or by descending output width"},
+
+    {.name="stats", .key='S',
+     .doc="Print statistics on the work carried out for each tree"},
+
+    {.name="trace", .key='r', .arg="PATH",
+     .doc="Dump the latency of pipeline stages in the Chrome trace format, "
+          "requires a library configured with --enable-tracing"},
+
     {0}
   };
   
@@ -264,7 +462,8 @@ main(int argc, char** argv) {
 
   struct robustness_analysis a = {
     .sample_timeout = UINT_MAX,
-    .threads = sysconf(_SC_NPROCESSORS_ONLN)
+    .threads = sysconf(_SC_NPROCESSORS_ONLN),
+    .sample_threads = 1
   };
     
   if(argp_parse(&argp, argc, argv, 0, 0, &a)) {
@@ -0,0 +1,59 @@
+/* Copyright (C) 2021 John Törnblom
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#include <stdio.h>
+#include <vote.h>
+
+#include "stats.h"
+
+
+/**
+ * Print the counters of a tree on a single line.
+ **/
+static void
+stats_print_tree(const vote_tree_stats_t *s) {
+  printf("%zu %zu %zu %zu %zu %zu\n", s->nb_abstracted, s->nb_settled,
+	 s->nb_bypassed, s->nb_refined, s->nb_nodes, s->nb_leaves);
+}
+
+
+void
+stats_print(const char *tool, const vote_stats_t *s) {
+  const vote_tree_stats_t *t = &s->total;
+
+  printf("%s:stats:mappings:   %zu\n", tool, s->nb_mappings);
+  printf("%s:stats:abstracted: %zu\n", tool, t->nb_abstracted);
+  printf("%s:stats:settled:    %zu\n", tool, t->nb_settled);
+  printf("%s:stats:bypassed:   %zu\n", tool, t->nb_bypassed);
+  printf("%s:stats:refined:    %zu\n", tool, t->nb_refined);
+  printf("%s:stats:nodes:      %zu\n", tool, t->nb_nodes);
+  printf("%s:stats:leaves:     %zu\n", tool, t->nb_leaves);
+
+  // abstracted settled bypassed refined nodes leaves, for each tree
+  for(size_t i=0; i<s->nb_trees; i++) {
+    printf("%s:stats:tree%zu:      ", tool, i);
+    stats_print_tree(&s->trees[i]);
+  }
+}
+
+
+void
+trace_dump(const char *filename) {
+  if(!vote_trace_dump(filename)) {
+    fprintf(stderr, "Unable to dump a trace to %s, was libvote configured "
+	    "with --enable-tracing?\n", filename);
+  }
+}
@@ -0,0 +1,38 @@
+/* Copyright (C) 2021 John Törnblom
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <vote.h>
+
+
+/**
+ * Print statistics collected by an analysis to stdout, one counter per line,
+ * prefixed with the name of a tool.
+ **/
+void stats_print(const char *tool, const vote_stats_t *s);
+
+
+/**
+ * Dump the spans recorded by the stages of the pipeline to a file in the
+ * Chrome trace format, or complain on stderr if that is not possible.
+ **/
+void trace_dump(const char *filename);
+
+
+#endif //STATS_H
@@ -0,0 +1,259 @@
+/* Copyright (C) 2021 John Törnblom
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vote.h>
+
+#include "synth.h"
+
+
+/**
+ * A growing string that an ensemble is encoded into.
+ **/
+typedef struct synth_buffer {
+  char   *data;
+  size_t  length;
+  size_t  capacity;
+} synth_buffer_t;
+
+
+/**
+ * The thresholds generated so far for a feature.
+ **/
+typedef struct synth_pool {
+  real_t *thresholds;
+  size_t  nb_thresholds;
+  size_t  capacity;
+} synth_pool_t;
+
+
+/**
+ * The names of post-processing algorithms in the VoTE JSON format.
+ **/
+static const char *synth_post_process[] = {
+  [VOTE_POST_PROCESS_NONE]    = "none",
+  [VOTE_POST_PROCESS_DIVISOR] = "divisor",
+  [VOTE_POST_PROCESS_SOFTMAX] = "softmax",
+  [VOTE_POST_PROCESS_SIGMOID] = "sigmoid"
+};
+
+
+/**
+ * Append formatted text to a buffer.
+ **/
+static void
+synth_printf(synth_buffer_t *b, const char *fmt, ...) {
+  va_list args;
+  int n;
+
+  va_start(args, fmt);
+  n = vsnprintf(b->data + b->length, b->capacity - b->length, fmt, args);
+  va_end(args);
+  assert(n >= 0);
+
+  if(b->length + (size_t)n >= b->capacity) {
+    b->capacity = 2 * (b->length + (size_t)n) + 1;
+    b->data = realloc(b->data, b->capacity);
+    assert(b->data);
+
+    va_start(args, fmt);
+    n = vsnprintf(b->data + b->length, b->capacity - b->length, fmt, args);
+    va_end(args);
+  }
+
+  b->length += (size_t)n;
+}
+
+
+/**
+ * Draw a threshold for a feature, and remember it for later reuse.
+ **/
+static real_t
+synth_threshold(const synth_params_t *p, synth_rng_t *rng, synth_pool_t *pools,
+		size_t feature) {
+  synth_pool_t *pool = &pools[feature];
+  real_t threshold;
+
+  if(p->reuse > 0 && pool->nb_thresholds && synth_uniform(rng) < p->reuse) {
+    return pool->thresholds[synth_index(rng, pool->nb_thresholds)];
+  }
+
+  if(p->data) {
+    size_t row = synth_index(rng, p->data->nb_rows);
+    threshold = vote_dataset_row(p->data, row)[feature];
+  } else {
+    threshold = synth_uniform(rng);
+  }
+
+  if(pool->nb_thresholds == pool->capacity) {
+    pool->capacity = pool->capacity ? pool->capacity * 2 : 64;
+    pool->thresholds = realloc(pool->thresholds,
+			       pool->capacity * sizeof(real_t));
+    assert(pool->thresholds);
+  }
+  pool->thresholds[pool->nb_thresholds++] = threshold;
+
+  return threshold;
+}
+
+
+/**
+ * Draw the value of a leaf for one of the outputs of a tree.
+ **/
+static real_t
+synth_value(const synth_params_t *p, synth_rng_t *rng, size_t tree,
+	    size_t output) {
+  switch(p->post_process) {
+  case VOTE_POST_PROCESS_SOFTMAX:
+  case VOTE_POST_PROCESS_SIGMOID:
+    if(tree % p->nb_outputs != output) {
+      return 0;
+    }
+    return 2 * synth_uniform(rng) - 1;
+
+  default:
+  case VOTE_POST_PROCESS_NONE:
+  case VOTE_POST_PROCESS_DIVISOR:
+    return synth_uniform(rng);
+  }
+}
+
+
+/**
+ * Append the nodes of a complete tree in breadth-first order, i.e. the
+ * children of node i are 2i+1 and 2i+2.
+ **/
+static void
+synth_tree(synth_buffer_t *b, const synth_params_t *p, synth_rng_t *rng,
+	   synth_pool_t *pools, size_t tree) {
+  size_t nb_nodes = ((size_t)2 << p->depth) - 1;
+  size_t nb_internal = nb_nodes / 2;
+  size_t *feature = calloc(nb_internal + 1, sizeof(size_t));
+
+  assert(feature);
+  for(size_t i=0; i<nb_internal; i++) {
+    feature[i] = synth_index(rng, p->nb_inputs);
+  }
+
+  synth_printf(b, "{\"nb_inputs\":%zu,\"nb_outputs\":%zu,\"normalize\":%s",
+	       p->nb_inputs, p->nb_outputs,
+	       p->post_process == VOTE_POST_PROCESS_DIVISOR ? "true" : "false");
+
+  synth_printf(b, ",\"left\":[");
+  for(size_t i=0; i<nb_nodes; i++) {
+    synth_printf(b, "%s%ld", i ? "," : "", i < nb_internal ? (long)(2*i+1) : -1L);
+  }
+
+  synth_printf(b, "],\"right\":[");
+  for(size_t i=0; i<nb_nodes; i++) {
+    synth_printf(b, "%s%ld", i ? "," : "", i < nb_internal ? (long)(2*i+2) : -1L);
+  }
+
+  synth_printf(b, "],\"feature\":[");
+  for(size_t i=0; i<nb_nodes; i++) {
+    synth_printf(b, "%s%ld", i ? "," : "", i < nb_internal ? (long)feature[i] : -2L);
+  }
+
+  synth_printf(b, "],\"threshold\":[");
+  for(size_t i=0; i<nb_nodes; i++) {
+    real_t threshold = -2;
+
+    if(i < nb_internal) {
+      threshold = synth_threshold(p, rng, pools, feature[i]);
+    }
+    synth_printf(b, "%s%.17g", i ? "," : "", threshold);
+  }
+
+  synth_printf(b, "],\"value\":[");
+  for(size_t i=0; i<nb_nodes; i++) {
+    synth_printf(b, "%s[", i ? "," : "");
+    for(size_t j=0; j<p->nb_outputs; j++) {
+      real_t value = i < nb_internal ? 0 : synth_value(p, rng, tree, j);
+      synth_printf(b, "%s%.17g", j ? "," : "", value);
+    }
+    synth_printf(b, "]");
+  }
+
+  synth_printf(b, "]}");
+  free(feature);
+}
+
+
+void
+synth_seed(synth_rng_t *rng, uint64_t seed) {
+  rng->state = seed;
+}
+
+
+real_t
+synth_uniform(synth_rng_t *rng) {
+  uint64_t z = (rng->state += 0x9e3779b97f4a7c15ULL);
+
+  // splitmix64, with the upper 53 bits as the mantissa
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  z = z ^ (z >> 31);
+
+  return (real_t)(z >> 11) * 0x1.0p-53;
+}
+
+
+size_t
+synth_index(synth_rng_t *rng, size_t n) {
+  size_t i = (size_t)(synth_uniform(rng) * (real_t)n);
+
+  return i < n ? i : n - 1;
+}
+
+
+vote_ensemble_t*
+synth_ensemble(const synth_params_t *p) {
+  synth_buffer_t b = {.capacity = 4096};
+  synth_pool_t *pools = calloc(p->nb_inputs, sizeof(synth_pool_t));
+  vote_ensemble_t *e;
+  synth_rng_t rng;
+
+  assert(p->nb_trees && p->nb_inputs && p->nb_outputs);
+  assert(!p->data || p->data->nb_cols >= p->nb_inputs);
+
+  assert(pools);
+  assert(p->post_process <= VOTE_POST_PROCESS_SIGMOID);
+
+  b.data = malloc(b.capacity);
+  assert(b.data);
+
+  synth_seed(&rng, p->seed);
+  synth_printf(&b, "{\"trees\":[");
+  for(size_t i=0; i<p->nb_trees; i++) {
+    synth_printf(&b, "%s", i ? "," : "");
+    synth_tree(&b, p, &rng, pools, i);
+  }
+  synth_printf(&b, "],\"post_process\":\"%s\"}",
+	       synth_post_process[p->post_process]);
+
+  e = vote_ensemble_load_string(b.data);
+  free(b.data);
+
+  for(size_t i=0; i<p->nb_inputs; i++) {
+    free(pools[i].thresholds);
+  }
+  free(pools);
+
+  return e;
+}
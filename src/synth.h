@@ -0,0 +1,83 @@
+/* Copyright (C) 2021 John Törnblom
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <stdint.h>
+#include <vote.h>
+
+
+/**
+ * A deterministic pseudo-random number generator, so that the same seed
+ * yields the same ensembles and samples on every platform.
+ **/
+typedef struct synth_rng {
+  uint64_t state;
+} synth_rng_t;
+
+
+/**
+ * The shape of a synthetic ensemble. Each tree is complete with the given
+ * depth, and tests features drawn uniformly. Thresholds are drawn uniformly
+ * from [0, 1), or from the values of a dataset, if any. With some
+ * probability, a threshold is instead reused from the nodes generated so far
+ * that test the same feature, like the binned thresholds of boosted trees.
+ *
+ * The post-processing decides the flavour of the leaves:
+ *  - none: every tree contributes to every output with values in [0, 1).
+ *  - divisor: a random forest, where every leaf holds a normalized
+ *    distribution over the outputs.
+ *  - softmax and sigmoid: boosted trees, where tree i contributes to output
+ *    i modulo the number of outputs with values in [-1, 1).
+ **/
+typedef struct synth_params {
+  size_t                nb_trees;
+  size_t                depth;
+  size_t                nb_inputs;
+  size_t                nb_outputs;
+  real_t                reuse;
+  vote_post_process_t   post_process;
+  uint64_t              seed;
+  const vote_dataset_t *data;
+} synth_params_t;
+
+
+/**
+ * Seed a pseudo-random number generator.
+ **/
+void synth_seed(synth_rng_t *rng, uint64_t seed);
+
+
+/**
+ * Draw a real uniformly from [0, 1).
+ **/
+real_t synth_uniform(synth_rng_t *rng);
+
+
+/**
+ * Draw an integer uniformly from [0, n).
+ **/
+size_t synth_index(synth_rng_t *rng, size_t n);
+
+
+/**
+ * Generate a synthetic ensemble.
+ **/
+vote_ensemble_t* synth_ensemble(const synth_params_t *p);
+
+
+#endif //SYNTH_H
@@ -0,0 +1,230 @@
+/* Copyright (C) 2021 John Törnblom
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <argp.h>
+#include <vote.h>
+
+#include "synth.h"
+
+
+/**
+ * The settings of the generator, together with the output file.
+ **/
+typedef struct synthesize_args {
+  synth_params_t  params;
+  vote_dataset_t *data;
+  const char     *filename;
+} synthesize_args_t;
+
+
+/**
+ * Parse a positive count.
+ **/
+static bool
+parse_count(const char *s, size_t *count) {
+  char *end;
+  unsigned long n = strtoul(s, &end, 10);
+
+  if(*s == '-' || *end || !n) {
+    return false;
+  }
+
+  *count = n;
+  return true;
+}
+
+
+/**
+ * Parse command line arguments.
+ **/
+static error_t
+parse_cb(int key, char *arg, struct argp_state *state) {
+  synthesize_args_t *a = state->input;
+  synth_params_t *p = &a->params;
+  char *end;
+
+  switch(key) {
+  case 'n': //trees
+    if(!parse_count(arg, &p->nb_trees)) {
+      argp_error(state, "Invalid number of trees %s", arg);
+    }
+    break;
+
+  case 'd': //depth
+    p->depth = strtoul(arg, &end, 10);
+    if(*arg == '-' || *end || p->depth > 24) {
+      argp_error(state, "Invalid depth %s", arg);
+    }
+    break;
+
+  case 'i': //inputs
+    if(!parse_count(arg, &p->nb_inputs)) {
+      argp_error(state, "Invalid number of inputs %s", arg);
+    }
+    break;
+
+  case 'o': //outputs
+    if(!parse_count(arg, &p->nb_outputs)) {
+      argp_error(state, "Invalid number of outputs %s", arg);
+    }
+    break;
+
+  case 'r': //reuse
+    p->reuse = strtod(arg, &end);
+    if(*end || p->reuse < 0 || p->reuse > 1) {
+      argp_error(state, "Invalid threshold reuse %s", arg);
+    }
+    break;
+
+  case 'p': //post-process
+    if(!strcmp(arg, "none")) {
+      p->post_process = VOTE_POST_PROCESS_NONE;
+    } else if(!strcmp(arg, "divisor")) {
+      p->post_process = VOTE_POST_PROCESS_DIVISOR;
+    } else if(!strcmp(arg, "softmax")) {
+      p->post_process = VOTE_POST_PROCESS_SOFTMAX;
+    } else if(!strcmp(arg, "sigmoid")) {
+      p->post_process = VOTE_POST_PROCESS_SIGMOID;
+    } else {
+      argp_error(state, "Unknown post-processing %s", arg);
+    }
+    break;
+
+  case 's': //seed
+    p->seed = strtoull(arg, &end, 10);
+    if(*arg == '-' || *end) {
+      argp_error(state, "Invalid seed %s", arg);
+    }
+    break;
+
+  case 'D': //data
+    if(!(a->data = vote_csv_load(arg))) {
+      fprintf(stderr, "Unable to load data from %s\n", arg);
+      return ARGP_ERR_UNKNOWN;
+    }
+    break;
+
+  case ARGP_KEY_ARG: //OUTPUT_FILE
+    if(state->arg_num > 0) {
+      argp_usage(state);
+    }
+    a->filename = arg;
+    break;
+
+  case ARGP_KEY_END:
+    if(state->arg_num < 1) {
+      argp_usage(state);
+    }
+    if(a->data && a->data->nb_cols < p->nb_inputs) {
+      argp_error(state, "Expected at least %ld columns in the data",
+		 p->nb_inputs);
+    }
+    break;
+
+  default:
+    return ARGP_ERR_UNKNOWN;
+  }
+
+  return 0;
+}
+
+
+/**
+ * Parse command line arguments, and write a synthetic ensemble to disk.
+ **/
+int
+main(int argc, char** argv) {
+  struct argp_option opts[] = {
+    {.name="trees", .key='n', .arg="NUMBER",
+     .doc="Number of trees (default 10)"},
+
+    {.name="depth", .key='d', .arg="NUMBER",
+     .doc="Depth of the trees, which are complete (default 4)"},
+
+    {.name="inputs", .key='i', .arg="NUMBER",
+     .doc="Number of input features (default 4)"},
+
+    {.name="outputs", .key='o', .arg="NUMBER",
+     .doc="Number of outputs (default 2)"},
+
+    {.name="reuse", .key='r', .arg="FRACTION",
+     .doc="Probability that a threshold is reused from earlier nodes that "
+          "test the same feature (default 0)"},
+
+    {.name="post-process", .key='p', .arg="NAME",
+     .doc="Generate a random forest (divisor, default), boosted trees "
+          "(softmax or sigmoid), or plain sums (none)"},
+
+    {.name="seed", .key='s', .arg="NUMBER",
+     .doc="Seed of the pseudo-random number generator (default 1)"},
+
+    {.name="data", .key='D', .arg="PATH",
+     .doc="Draw thresholds from the values of a dataset in the CSV format"},
+
+    {0}
+  };
+
+  struct argp argp = {
+    .parser   = parse_cb,
+    .doc      = "Generate a synthetic tree ensemble with a given shape, "
+                "deterministically from a seed, and write it to a file in "
+                "the VoTE JSON format.",
+    .args_doc = "OUTPUT_FILE",
+    .options  = opts
+  };
+
+  synthesize_args_t a = {
+    .params = {
+      .nb_trees = 10,
+      .depth = 4,
+      .nb_inputs = 4,
+      .nb_outputs = 2,
+      .post_process = VOTE_POST_PROCESS_DIVISOR,
+      .seed = 1
+    }
+  };
+  vote_ensemble_t *e;
+  bool b;
+
+  if(argp_parse(&argp, argc, argv, 0, 0, &a)) {
+    exit(1);
+  }
+
+  a.params.data = a.data;
+  e = synth_ensemble(&a.params);
+  b = vote_ensemble_save_file(e, a.filename);
+
+  if(!b) {
+    fprintf(stderr, "Unable to write model to %s\n", a.filename);
+  }
+
+  vote_ensemble_del(e);
+  if(a.data) {
+    vote_dataset_del(a.data);
+  }
+
+  return !b;
+}
+
+
+/**
+ * Accessed by argp_parse()
+ **/
+const char *argp_program_version = VERSION;
+const char *argp_program_bug_address = PACKAGE_BUGREPORT;
@@ -19,8 +19,11 @@ along with this program; see the file COPYING. If not, see
 #include <stddef.h>
 #include <time.h>
 #include <math.h>
+#include <string.h>
 #include <vote.h>
 
+#include "stats.h"
+
 
 /**
  * Dumps throughput (number of precise mappings per second) to stdout.
@@ -51,8 +54,27 @@ sample_throughput(void *ctx, vote_mapping_t *m) {
  * Parse command line arguments and launch program.
  **/
 int main(int argc, char** argv) {
+  const char *trace = NULL;
+  bool stats = false;
+
+  // optionally print statistics collected during the enumeration, and dump
+  // the latency of pipeline stages to a file
+  while(argc > 1 && !strncmp(argv[1], "--", 2)) {
+    if(!strcmp(argv[1], "--stats")) {
+      stats = true;
+    } else if(!strncmp(argv[1], "--trace=", 8)) {
+      trace = argv[1] + 8;
+    } else {
+      printf("Unknown option %s\n", argv[1]);
+      return 1;
+    }
+    argv[1] = argv[0];
+    argv++;
+    argc--;
+  }
+
   if(argc < 2) {
-    printf("usage: %s <model file>\n", argv[0]);
+    printf("usage: %s [--stats] [--trace=FILE] <model file>\n", argv[0]);
     return 1;
   }
   
@@ -73,10 +95,25 @@ int main(int argc, char** argv) {
     domain[i].upper = VOTE_INFINITY;
   }
 
-  vote_ensemble_forall(e, domain, sample_throughput, &t);
-  vote_ensemble_del(e);
+  vote_plan_t *p = vote_plan_new(e, VOTE_STRATEGY_REFINE, 1);
+  vote_stats_t *s = vote_stats_new(e);
+
+  vote_plan_set_stats(p, stats);
+  vote_plan_run(p, domain, sample_throughput, &t);
+  vote_plan_stats(p, s);
 
   printf("\n");
+  if(stats) {
+    stats_print("throughput", s);
+  }
+  if(trace) {
+    trace_dump(trace);
+  }
+
+  vote_stats_del(s);
+  vote_plan_del(p);
+  vote_ensemble_del(e);
+
   return 0;
 }
 